@@ -1,8 +1,13 @@
 #include "basevar.hpp"
+#include "domain.hpp"
 #include "varhandle.hpp"
 
 namespace eq {
 
+BaseVar::BaseVar(const detail::DomainOps& ops)
+	: domainOps(&ops)
+{ }
+
 BaseVar::~BaseVar()
 {
 	while (!handles.empty()) {
@@ -15,14 +20,42 @@ BaseVar::~BaseVar()
 }
 
 BaseVar::BaseVar(BaseVar&& other)
+	: domainOps(other.domainOps)
 {
 	operator=(std::move(other));
 }
 
+void BaseVar::setDomainPtr(BaseDomainPtr ptr)
+{
+	// Previous domain is released after unlocking
+	std::lock_guard<detail::RefLock> lock(domainLock);
+	domain.swap(ptr);
+}
+
+BaseDomainPtr BaseVar::getDomainPtr() const
+{
+	std::lock_guard<detail::RefLock> lock(domainLock);
+	return domain;
+}
+
+BaseDomainPtr BaseVar::createDomain() const
+{
+	return domainOps->create();
+}
+
+void BaseVar::join(const BaseDomainPtr& d)
+{
+	ensure(!getDomainPtr() && "Var already has a domain");
+	setDomainPtr(d);
+	domainOps->addVar(*d, *this);
+}
+
 BaseVar& BaseVar::operator=(BaseVar&& other)
 {
 	if (this != &other) {
+		domainOps= other.domainOps;
 		domain= std::move(other.domain);
+		index= other.index;
 
 		// Clear current handles
 		for (auto&& h : handles) {
@@ -1,12 +1,14 @@
 #ifndef EQ_BASEVAR_HPP
 #define EQ_BASEVAR_HPP
 
+#include "refptr.hpp"
 #include "util.hpp"
 
 namespace eq {
 
 class BaseDomain;
-using BaseDomainPtr= SharedPtr<BaseDomain>;
+using BaseDomainPtr= RefPtr<BaseDomain>;
+class BaseVar;
 class VarHandle;
 
 enum class VarType {
@@ -18,9 +20,21 @@ template <typename T, VarType type>
 class Var;
 using PriorityVar= Var<int, VarType::priority>;
 
+namespace detail {
+
+/// Typed operations for creating the domain of a variable on first use
+struct DomainOps {
+	BaseDomainPtr (*create)();
+	void (*addVar)(BaseDomain& d, BaseVar& var);
+};
+
+} // detail
+
 class BaseVar {
 public:
-	BaseVar()= default;
+	/// Domain is created only when the variable is first related or read,
+	/// see `detail::DomainsLock`
+	explicit BaseVar(const detail::DomainOps& ops);
 	~BaseVar();
 	BaseVar(const BaseVar&)= delete;
 	BaseVar(BaseVar&& other);
@@ -31,14 +45,31 @@ public:
 
 	/// @todo These could be protected
 	BaseDomain& getDomain() const { return *domain; }
-	void setDomainPtr(BaseDomainPtr ptr) { domain= ptr; }
-	BaseDomainPtr getDomainPtr() { return domain; }
+	/// Guarded, because other threads may be locking the domain
+	/// while it's being merged, see `detail::DomainsLock`
+	void setDomainPtr(BaseDomainPtr ptr);
+	/// Null if the variable hasn't been related or read yet
+	BaseDomainPtr getDomainPtr() const;
+
+	/// @return New empty domain of the type of the variable
+	BaseDomainPtr createDomain() const;
+	/// Adds variable without a domain to `d`, which must be locked
+	void join(const BaseDomainPtr& d);
+
+	/// Position of the value in the domain, see `Domain::getValues`
+	std::size_t getIndex() const { return index; }
+	void setIndex(std::size_t i) { index= i; }
 
 private:
 	friend class VarHandle;
+	const detail::DomainOps* domainOps;
 	BaseDomainPtr domain;
+	mutable detail::RefLock domainLock;
+	std::size_t index= 0;
 	/// Handles to this
+	/// Expressions of different threads can refer to the same variable
 	DynArray<VarHandle*> handles;
+	SpinLock handlesLock;
 };
 
 } // eq
@@ -0,0 +1,63 @@
+#ifndef EQ_BATCH_HPP
+#define EQ_BATCH_HPP
+
+#include "basevar.hpp"
+#include "expr.hpp"
+#include "model.hpp"
+#include "util.hpp"
+
+namespace eq {
+
+/// Expression compiled for evaluating over many assignments of its variables
+/// e.g. for checking which of candidate layouts satisfy a relation
+///
+/// Assignments are given as columns, one per variable, so that every
+/// operation of the expression is a loop over a block of values, which
+/// compilers vectorize. Values of variables aren't read or solved.
+///
+/// Relations give 1 or 0. Integer division by zero gives 0.
+template <typename T>
+class BatchEval {
+public:
+	/// Assignments evaluated at once
+	static constexpr std::size_t blockSize= 256;
+
+	/// @param vars Variables in the order of columns.
+	///             Every variable of `e` must be present.
+	template <typename E>
+	BatchEval(Expr<E> e, const DynArray<const BaseVar*>& vars);
+
+	std::size_t varCount() const { return columnCount; }
+
+	/// @param columns `varCount()` arrays of `count` values
+	/// @param out Result of every assignment, `count` values
+	void eval(const T* const* columns, std::size_t count, T* out) const;
+
+	DynArray<T> eval(const DynArray<const T*>& columns, std::size_t count) const;
+
+	/// @return Indices of assignments for which result is nonzero
+	DynArray<std::size_t> select(	const DynArray<const T*>& columns,
+									std::size_t count) const;
+
+private:
+	struct Step {
+		Model::OpCode op;
+		/// Column for `OpCode::var`, index of `constants` for `OpCode::constant`
+		std::uint32_t index;
+	};
+
+	void evalBlock(	const T* const* columns, std::size_t offset, std::size_t n,
+					T* stack, T* out) const;
+
+	DynArray<Step> steps;
+	DynArray<T> constants;
+	std::size_t columnCount;
+	/// Max number of blocks on the stack
+	std::size_t depth= 0;
+};
+
+#include "batch.tpp"
+
+} // eq
+
+#endif // EQ_BATCH_HPP
@@ -0,0 +1,157 @@
+namespace detail {
+
+template <typename T, typename F>
+void lanes(T* lhs, const T* rhs, std::size_t n, F f)
+{
+	for (std::size_t i= 0; i < n; ++i)
+		lhs[i]= f(lhs[i], rhs[i]);
+}
+
+template <typename T, typename F>
+void lanes(T* e, std::size_t n, F f)
+{
+	for (std::size_t i= 0; i < n; ++i)
+		e[i]= f(e[i]);
+}
+
+template <typename T>
+T divide(T lhs, T rhs, std::true_type /*integral*/)
+{ return rhs != 0 ? lhs/rhs : 0; }
+
+template <typename T>
+T divide(T lhs, T rhs, std::false_type /*integral*/)
+{ return lhs/rhs; }
+
+} // detail
+
+template <typename T>
+constexpr std::size_t BatchEval<T>::blockSize;
+
+template <typename T>
+template <typename E>
+BatchEval<T>::BatchEval(Expr<E> e, const DynArray<const BaseVar*>& vars)
+	: columnCount(vars.size())
+{
+	auto type= Model::typeOf<T>();
+	detail::ModelWriter w{type};
+	for (auto&& v : vars)
+		w.addVar(*v, T{}, T{});
+	detail::EmitInstrs<Expr<E>>::eval(w, e);
+
+	std::size_t size= 0;
+	for (auto&& instr : w.getModel().instrs) {
+		Step s= {instr.op, instr.index};
+		switch (instr.op) {
+			case Model::OpCode::var:
+				++size;
+			break;
+			case Model::OpCode::constant:
+				s.index= constants.size();
+				constants.push_back(numberAs<T>(instr.value, type));
+				++size;
+			break;
+			case Model::OpCode::pos:
+			case Model::OpCode::neg:
+			case Model::OpCode::not_:
+			break;
+			default:
+				--size;
+		}
+		depth= std::max(depth, size);
+		steps.push_back(s);
+	}
+	ensure(size == 1 && "Invalid expression");
+}
+
+template <typename T>
+void BatchEval<T>::eval(const T* const* columns, std::size_t count, T* out) const
+{
+	DynArray<T> stack(depth*blockSize);
+	for (std::size_t offset= 0; offset < count; offset += blockSize) {
+		std::size_t n= std::min(blockSize, count - offset);
+		evalBlock(columns, offset, n, stack.data(), out + offset);
+	}
+}
+
+template <typename T>
+DynArray<T> BatchEval<T>::eval(const DynArray<const T*>& columns, std::size_t count) const
+{
+	ensure(columns.size() == columnCount);
+	DynArray<T> out(count);
+	eval(columns.data(), count, out.data());
+	return out;
+}
+
+template <typename T>
+DynArray<std::size_t> BatchEval<T>::select(
+		const DynArray<const T*>& columns,
+		std::size_t count) const
+{
+	DynArray<T> results= eval(columns, count);
+	DynArray<std::size_t> selected;
+	for (std::size_t i= 0; i < count; ++i) {
+		if (results[i] != 0)
+			selected.push_back(i);
+	}
+	return selected;
+}
+
+template <typename T>
+void BatchEval<T>::evalBlock(
+		const T* const* columns, std::size_t offset, std::size_t n,
+		T* stack, T* out) const
+{
+	using Op= Model::OpCode;
+	using Integral= typename std::is_integral<T>::type;
+
+	// Blocks of the stack are `blockSize` apart, `top` is the next free one
+	T* top= stack;
+	for (auto&& s : steps) {
+		T* lhs= top - 2*blockSize;
+		T* rhs= top - blockSize;
+		switch (s.op) {
+			case Op::var:
+				std::copy(columns[s.index] + offset, columns[s.index] + offset + n, top);
+				top += blockSize;
+			break;
+			case Op::constant:
+				std::fill(top, top + n, constants[s.index]);
+				top += blockSize;
+			break;
+			case Op::pos:
+			break;
+			case Op::neg:
+				detail::lanes(rhs, n, [] (T e) { return -e; });
+			break;
+			case Op::not_:
+				detail::lanes(rhs, n, [] (T e) { return T(e == 0); });
+			break;
+			default:
+				switch (s.op) {
+					case Op::add: detail::lanes(lhs, rhs, n, [] (T a, T b) { return a + b; }); break;
+					case Op::sub: detail::lanes(lhs, rhs, n, [] (T a, T b) { return a - b; }); break;
+					case Op::mul: detail::lanes(lhs, rhs, n, [] (T a, T b) { return a*b; }); break;
+					case Op::div:
+						detail::lanes(lhs, rhs, n,
+							[] (T a, T b) { return detail::divide(a, b, Integral{}); });
+					break;
+					case Op::eq: detail::lanes(lhs, rhs, n, [] (T a, T b) { return T(a == b); }); break;
+					case Op::neq: detail::lanes(lhs, rhs, n, [] (T a, T b) { return T(a != b); }); break;
+					case Op::gr: detail::lanes(lhs, rhs, n, [] (T a, T b) { return T(a > b); }); break;
+					case Op::ls: detail::lanes(lhs, rhs, n, [] (T a, T b) { return T(a < b); }); break;
+					case Op::geq: detail::lanes(lhs, rhs, n, [] (T a, T b) { return T(a >= b); }); break;
+					case Op::leq: detail::lanes(lhs, rhs, n, [] (T a, T b) { return T(a <= b); }); break;
+					case Op::and_:
+						detail::lanes(lhs, rhs, n, [] (T a, T b) { return T((a != 0) & (b != 0)); });
+					break;
+					case Op::or_:
+						detail::lanes(lhs, rhs, n, [] (T a, T b) { return T((a != 0) | (b != 0)); });
+					break;
+					default: ensure(0 && "Unknown op");
+				}
+				top -= blockSize;
+		}
+	}
+	ensure(top == stack + blockSize);
+	std::copy(stack, stack + n, out);
+}
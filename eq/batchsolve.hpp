@@ -0,0 +1,48 @@
+#ifndef EQ_BATCHSOLVE_HPP
+#define EQ_BATCHSOLVE_HPP
+
+#include "executor.hpp"
+#include "model.hpp"
+#include "var.hpp"
+
+namespace eq {
+
+/// Solutions of instances of a model, see `solveBatch`
+template <typename T>
+struct BatchSolution {
+	std::size_t varCount= 0;
+	/// `varCount` values per instance
+	DynArray<T> values;
+	/// Nonzero if instance had a solution. Values of others are zero.
+	DynArray<std::uint8_t> found;
+
+	std::size_t size() const { return found.size(); }
+	const T* operator[](std::size_t instance) const
+	{ return values.data() + instance*varCount; }
+};
+
+/// Solves `m` once for every row of `params`, on threads of `executor`
+/// Instances share the model, but every instance has its own solver.
+/// @param param_vars Indices of model variables which are fixed per instance
+/// @param params `param_vars.size()` values per instance
+template <typename T>
+BatchSolution<T> solveBatch(
+		const Model& m,
+		const DynArray<std::uint32_t>& param_vars,
+		const DynArray<T>& params,
+		Executor& executor= Executor::global());
+
+namespace detail {
+
+/// @param bounds Min and max of every variable
+/// @return false if there's no solution
+template <typename T>
+bool solveInstance(const Model& m, const DynArray<T>& bounds, T* out);
+
+} // detail
+
+#include "batchsolve.tpp"
+
+} // eq
+
+#endif // EQ_BATCHSOLVE_HPP
@@ -0,0 +1,65 @@
+template <typename T>
+BatchSolution<T> solveBatch(
+		const Model& m,
+		const DynArray<std::uint32_t>& param_vars,
+		const DynArray<T>& params,
+		Executor& executor)
+{
+	ensure(m.type == Model::typeOf<T>() && "Model type mismatch");
+	ensure(!param_vars.empty() && params.size() % param_vars.size() == 0);
+	for (auto&& i : param_vars)
+		ensure(i < m.vars.size() && "Parameter not in model");
+
+	DynArray<T> bounds;
+	for (auto&& def : m.vars) {
+		bounds.push_back(numberAs<T>(def.min, m.type));
+		bounds.push_back(numberAs<T>(def.max, m.type));
+	}
+
+	BatchSolution<T> result;
+	result.varCount= m.vars.size();
+	std::size_t instance_count= params.size()/param_vars.size();
+	result.values.resize(instance_count*result.varCount);
+	result.found.resize(instance_count);
+
+	executor.parallelFor(instance_count,
+		[&] (std::size_t instance)
+		{
+			// Parameters are fixed by bounds instead of relations
+			DynArray<T> instance_bounds= bounds;
+			const T* row= params.data() + instance*param_vars.size();
+			for (std::size_t i= 0; i < param_vars.size(); ++i) {
+				instance_bounds[param_vars[i]*2]= row[i];
+				instance_bounds[param_vars[i]*2 + 1]= row[i];
+			}
+
+			T* out= result.values.data() + instance*result.varCount;
+			result.found[instance]= detail::solveInstance(m, instance_bounds, out);
+		});
+	return result;
+}
+
+namespace detail {
+
+template <typename T>
+bool solveInstance(const Model& m, const DynArray<T>& bounds, T* out)
+{
+	eq::ChooseSolver<T> solver;
+	for (std::size_t i= 0; i < m.vars.size(); ++i)
+		solver.addVar(i, bounds[i*2], bounds[i*2 + 1]);
+
+	for (std::size_t i= 0; i < m.rels.size(); ++i) {
+		solver.addProgram(program(m, i),
+			[] (std::uint32_t var) -> std::size_t { return var; });
+	}
+
+	if (!solver.solve())
+		return false;
+
+	auto&& solution= solver.getSolution();
+	ensure(solution.size() == m.vars.size());
+	std::copy(solution.begin(), solution.end(), out);
+	return true;
+}
+
+} // detail
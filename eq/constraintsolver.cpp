@@ -9,8 +9,9 @@ namespace detail {
 /// @todo Actually implement the differing algorithm
 class MaximizeVar : public op::SearchMonitor {
 public:
-	MaximizeVar(op::Solver& solver, op::IntVar* var)
-		: SearchMonitor(&solver), var_(var) { }
+	/// @param shared Best value found by other searches, or null
+	MaximizeVar(op::Solver& solver, op::IntVar* var, std::atomic<int64>* shared)
+		: SearchMonitor(&solver), var_(var), shared_(shared) { }
 	virtual ~MaximizeVar() { }
 	
 	int64 best() const { return best_; }
@@ -25,6 +26,13 @@ public:
 
 	virtual void RestartSearch() { ApplyBound(); }
 	virtual void RefuteDecision(op::Decision* d) { ApplyBound(); }
+
+	/// Other searches may have improved the bound meanwhile
+	virtual void BeginNextDecision(op::DecisionBuilder*)
+	{
+		if (shared_)
+			ApplyBound();
+	}
 	
 	virtual bool AtSolution()
 	{
@@ -32,11 +40,21 @@ public:
 		if (!hasInitSolution_ || val > best_)
 			best_= val;
 		hasInitSolution_= true;
+
+		if (shared_) {
+			int64 shared_best= shared_->load();
+			while (	val > shared_best &&
+					!shared_->compare_exchange_weak(shared_best, val))
+				;
+		}
+		return true;
 	}
 
 	virtual bool AcceptSolution()
 	{
 		int64 val= var_->Value();
+		if (shared_ && val <= shared_->load())
+			return false;
 		if (!hasInitSolution_)
 			return true;
 		else
@@ -57,69 +75,524 @@ public:
 
 	void ApplyBound()
 	{
-		if (hasInitSolution_) {
+		int64 bound= hasInitSolution_ ? best_ : kint64min;
+		if (shared_)
+			bound= std::max(bound, shared_->load());
+		if (bound != kint64min) {
 			/// @todo Searching by dividing ranges
-			var_->SetMin(best_ + 1);
+			var_->SetMin(bound + 1);
 		}
 	}
 	 
 private:
 	op::IntVar* const var_= nullptr;
+	std::atomic<int64>* const shared_= nullptr;
 	int64 best_= 0;
 	bool hasInitSolution_= false;
 	
 	DISALLOW_COPY_AND_ASSIGN(MaximizeVar);
 };
 
+/// Limits search to a subtree before the actual decisions
+/// Changes are undone when the search ends, so the solver can be reused
+class RestrictRange : public op::DecisionBuilder {
+public:
+	RestrictRange(op::IntVar* var, int64 min, int64 max)
+		: var(var), min(min), max(max) { }
+
+	virtual op::Decision* Next(op::Solver*)
+	{
+		var->SetRange(min, max);
+		return nullptr;
+	}
+
+	virtual std::string DebugString() const { return "RestrictRange"; }
+
+private:
+	op::IntVar* const var;
+	const int64 min;
+	const int64 max;
+};
+
+/// Records the range of the first unbound variable after initial
+/// propagation, and ends the search without making decisions
+class PropagatedRange : public op::DecisionBuilder {
+public:
+	PropagatedRange(const std::vector<op::IntVar*>& vars, ConstraintSolver::Subtree& range)
+		: vars(vars), range(range) { }
+
+	virtual op::Decision* Next(op::Solver*)
+	{
+		range= ConstraintSolver::Subtree{0, vars.front()->Min(), vars.front()->Max()};
+		for (std::size_t i= 0; i < vars.size(); ++i) {
+			if (!vars[i]->Bound()) {
+				range= ConstraintSolver::Subtree{i, vars[i]->Min(), vars[i]->Max()};
+				break;
+			}
+		}
+		return nullptr;
+	}
+
+	virtual std::string DebugString() const { return "PropagatedRange"; }
+
+private:
+	const std::vector<op::IntVar*>& vars;
+	ConstraintSolver::Subtree& range;
+};
+
 	
 
+/// Sides of rectangles which are `<=` for each alternative of non-overlap
+/// a left of b, b left of a, a below b, b below a
+struct DisjointSides {
+	DisjointSides(const RectVars& a, const RectVars& b)
+		: before{{a[2], b[2], a[3], b[3]}}
+		, after{{b[0], a[0], b[1], a[1]}}
+	{ }
+
+	RectVars before;
+	RectVars after;
+};
+
+/// Propagates all four sides of containment with one demon
+class ContainsConstraint : public op::Constraint {
+public:
+	ContainsConstraint(op::Solver* s, const RectVars& outer, const RectVars& inner)
+		: Constraint(s), outer(outer), inner(inner) { }
+
+	virtual void Post()
+	{
+		op::Demon* demon= op::MakeConstraintDemon0(
+				solver(), this, &ContainsConstraint::propagate, "propagate");
+		for (std::size_t i= 0; i < 4; ++i) {
+			outer[i]->WhenRange(demon);
+			inner[i]->WhenRange(demon);
+		}
+	}
+
+	virtual void InitialPropagate() { propagate(); }
+
+	virtual std::string DebugString() const { return "Contains"; }
+
+	void propagate()
+	{
+		// Left and bottom of outer are below those of inner
+		for (std::size_t i= 0; i < 2; ++i) {
+			inner[i]->SetMin(outer[i]->Min());
+			outer[i]->SetMax(inner[i]->Max());
+		}
+		// Right and top above
+		for (std::size_t i= 2; i < 4; ++i) {
+			inner[i]->SetMax(outer[i]->Max());
+			outer[i]->SetMin(inner[i]->Min());
+		}
+	}
+
+private:
+	const RectVars outer;
+	const RectVars inner;
+};
+
+/// Fails when rectangles can't be separated along any side,
+/// and enforces the separation when only one is left
+class DisjointConstraint : public op::Constraint {
+public:
+	DisjointConstraint(op::Solver* s, const RectVars& a, const RectVars& b)
+		: Constraint(s), a(a), b(b), sides(a, b) { }
+
+	virtual void Post()
+	{
+		op::Demon* demon= op::MakeConstraintDemon0(
+				solver(), this, &DisjointConstraint::propagate, "propagate");
+		for (std::size_t i= 0; i < 4; ++i) {
+			a[i]->WhenRange(demon);
+			b[i]->WhenRange(demon);
+		}
+	}
+
+	virtual void InitialPropagate() { propagate(); }
+
+	virtual std::string DebugString() const { return "Disjoint"; }
+
+	void propagate()
+	{
+		std::size_t possible_count= 0;
+		std::size_t possible= 0;
+		for (std::size_t i= 0; i < 4; ++i) {
+			if (sides.before[i]->Min() <= sides.after[i]->Max()) {
+				++possible_count;
+				possible= i;
+			}
+		}
+
+		if (possible_count == 0) {
+			solver()->Fail();
+		} else if (possible_count == 1) {
+			sides.before[possible]->SetMax(sides.after[possible]->Max());
+			sides.after[possible]->SetMin(sides.before[possible]->Min());
+		}
+	}
+
+private:
+	const RectVars a;
+	const RectVars b;
+	const DisjointSides sides;
+};
+
+op::Constraint* makeContains(op::Solver& s, const RectVars& outer, const RectVars& inner)
+{ return s.RevAlloc(new ContainsConstraint(&s, outer, inner)); }
+
+op::Constraint* makeDisjoint(op::Solver& s, const RectVars& a, const RectVars& b)
+{ return s.RevAlloc(new DisjointConstraint(&s, a, b)); }
+
+op::IntVar* makeContainsVar(op::Solver& s, const RectVars& outer, const RectVars& inner)
+{
+	std::vector<op::IntVar*> holds;
+	for (std::size_t i= 0; i < 2; ++i)
+		holds.push_back(s.MakeIsLessOrEqualVar(outer[i], inner[i]));
+	for (std::size_t i= 2; i < 4; ++i)
+		holds.push_back(s.MakeIsLessOrEqualVar(inner[i], outer[i]));
+	return s.MakeMin(holds)->Var();
+}
+
+op::IntVar* makeDisjointVar(op::Solver& s, const RectVars& a, const RectVars& b)
+{
+	DisjointSides sides(a, b);
+	std::vector<op::IntVar*> holds;
+	for (std::size_t i= 0; i < 4; ++i)
+		holds.push_back(s.MakeIsLessOrEqualVar(sides.before[i], sides.after[i]));
+	return s.MakeMax(holds)->Var();
+}
+
+op::Constraint* makeConstraint(
+		op::Solver& s,
+		Model::OpCode code,
+		op::IntExpr* lhs,
+		op::IntExpr* rhs)
+{
+	using Op= Model::OpCode;
+	switch (code) {
+		case Op::eq: return s.MakeEquality(lhs, rhs);
+		case Op::neq: return s.MakeNonEquality(lhs, rhs);
+		case Op::gr: return s.MakeGreater(lhs, rhs);
+		case Op::ls: return s.MakeLess(lhs, rhs);
+		case Op::geq: return s.MakeGreaterOrEqual(lhs, rhs);
+		case Op::leq: return s.MakeLessOrEqual(lhs, rhs);
+		default: ensure(0 && "Not a relation"); return nullptr;
+	}
+}
+
+op::IntVar* makeSuccessVar(
+		op::Solver& s,
+		Model::OpCode code,
+		op::IntExpr* lhs,
+		op::IntExpr* rhs)
+{
+	using Op= Model::OpCode;
+	switch (code) {
+		case Op::eq: return s.MakeIsEqualVar(lhs, rhs);
+		case Op::neq: return s.MakeIsDifferentVar(lhs, rhs);
+		case Op::gr: return s.MakeIsGreaterVar(lhs, rhs);
+		case Op::ls: return s.MakeIsLessVar(lhs, rhs);
+		case Op::geq: return s.MakeIsGreaterOrEqualVar(lhs, rhs);
+		case Op::leq: return s.MakeIsLessOrEqualVar(lhs, rhs);
+		default: ensure(0 && "Not a relation"); return nullptr;
+	}
+}
+
 } // detail
 
-void ConstraintSolver::addVar(int& ref)
+auto ConstraintSolver::portfolioMember(Options options, std::size_t i) -> Options
+{
+	if (i == 1) {
+		options.branching= options.branching == Branching::center ?
+			Branching::split : Branching::center;
+	} else if (i > 1) {
+		options.branching= Branching::random;
+		options.seed += static_cast<int>(i);
+	}
+	options.portfolio= 1;
+	return options;
+}
+
+void ConstraintSolver::addVar(std::size_t index)
 {
-	vars.add(ref, *solver.MakeIntVar(minInt, maxInt));
+	addVar(index, minInt, maxInt);
 }
 
-void ConstraintSolver::apply()
+void ConstraintSolver::addVar(std::size_t index, std::int64_t min, std::int64_t max)
 {
-	/// @todo Should undo this after solving
-	auto success_amount= solver.MakeSum(successAmounts)->Var();
-	auto optimizer= solver.RevAlloc(new detail::MaximizeVar(solver, success_amount));
+	vars.add(index, *solver.MakeIntVar(min, max));
+}
 
-	std::vector<op::IntVar*> solver_vars;
-	for (auto&& v : vars) {
-		solver_vars.push_back(v.model);
+bool ConstraintSolver::solve()
+{
+	if (options.objective == Objective::lexicographic)
+		return solveLexicographic();
+
+	int64 best;
+	return search(weightedObjective(), best);
+}
+
+auto ConstraintSolver::split(std::size_t count) -> DynArray<Subtree>
+{
+	ensure(vars.size() > 0 && count > 0);
+	ensure(!searching && "Search already ongoing");
+
+	// Bounds are restored when the search ends
+	std::vector<op::IntVar*> solver_vars(vars.begin(), vars.end());
+	Subtree range{};
+	if (!solver.Solve(solver.RevAlloc(new detail::PropagatedRange(solver_vars, range))))
+		return DynArray<Subtree>{};
+	int64 min= range.min, max= range.max;
+
+	// Unsigned, so that big ranges of ConstraintSolver64 don't overflow
+	uint64 width= static_cast<uint64>(max) - static_cast<uint64>(min) + 1;
+	uint64 chunk= (width + count - 1)/count;
+
+	DynArray<Subtree> subtrees;
+	for (uint64 offset= 0; offset < width; offset += chunk) {
+		int64 begin= min + static_cast<int64>(offset);
+		int64 end= width - offset <= chunk ? max : begin + static_cast<int64>(chunk - 1);
+		subtrees.push_back(Subtree{range.var, begin, end});
 	}
-	auto db= solver.MakePhase(
-			solver_vars,
-			op::Solver::CHOOSE_FIRST_UNBOUND,
-			op::Solver::ASSIGN_CENTER_VALUE);
+	return subtrees;
+}
 
-	solver.NewSearch(db, optimizer);
-	if (solver.NextSolution()) {
-		// Apparently last solution is the one which has the best success amount
-		do {
-			// Apply solution to actual variables
-			for (auto&& v : vars) {
-				ensure(v.actual && v.model);
-				*v.actual= v.model->Value();
-				//std::cout << "Solution: " << v.model->Value() << std::endl;
-			}
-		} while (solver.NextSolution());
-	} else {
+bool ConstraintSolver::solveShared(SharedSearch& shared, int64& best)
+{
+	ensure(options.objective == Objective::weighted);
+	op::IntVar* objective= weightedObjective();
+
+	bool found= false;
+	std::size_t i;
+	while ((i= shared.next++) < shared.subtrees.size()) {
+		// Solution is replaced only by better ones, as they must beat
+		// the shared bound which includes the previous ones
+		int64 subtree_best;
+		if (search(objective, subtree_best, &shared, shared.subtrees[i])) {
+			best= subtree_best;
+			found= true;
+		}
+	}
+	return found;
+}
+
+op::IntVar* ConstraintSolver::weightedObjective()
+{
+	// One scalar product instead of a product variable per success
+	std::vector<op::IntVar*> success_vars;
+	std::vector<int64> amounts;
+	for (auto&& s : successes) {
+		success_vars.push_back(s.second);
+		amounts.push_back(s.first);
+	}
+	return solver.MakeScalProd(success_vars, amounts)->Var();
+}
+
+bool ConstraintSolver::solveLexicographic()
+{
+	auto by_priority= successes;
+	std::stable_sort(by_priority.begin(), by_priority.end(),
+		[] (const std::pair<int, op::IntVar*>& a, const std::pair<int, op::IntVar*>& b)
+		{ return a.first > b.first; });
+
+	// Objective of a level is only the count of its successes
+	auto it= by_priority.begin();
+	do {
+		std::vector<op::IntVar*> level;
+		auto level_end= it;
+		while (level_end != by_priority.end() && level_end->first == it->first) {
+			level.push_back(level_end->second);
+			++level_end;
+		}
+		it= level_end;
+
+		auto level_success= solver.MakeSum(level)->Var();
+		int64 best;
+		if (!search(level_success, best))
+			return false;
+
+		// Lower levels can't sacrifice this one
+		solver.AddConstraint(solver.MakeEquality(level_success, best));
+	} while (it != by_priority.end());
+
+	return true;
+}
+
+bool ConstraintSolver::search(
+		op::IntVar* objective,
+		int64& best,
+		SharedSearch* shared,
+		Subtree subtree)
+{
+	startSearch(objective, shared, subtree);
+
+	// Apparently last solution is the one which has the best success amount
+	bool found= false;
+	while (nextSolution(true))
+		found= true;
+
+	if (!found && !shared && !cancelled()) {
 		/// @todo Throw
 		std::cout << "Solving error, failure count: " << solver.failures() << std::endl;
 	}
-	
+
+	best= optimizer->best();
+	// Best solution so far isn't known to be optimal
+	if (cancelled())
+		return false;
+	return found;
+}
+
+void ConstraintSolver::startSearch(
+		op::IntVar* objective,
+		SharedSearch* shared,
+		Subtree subtree)
+{
+	ensure(!searching && "Search already ongoing");
+	optimizer= solver.RevAlloc(new detail::MaximizeVar(
+				solver, objective, shared ? &shared->best : nullptr));
+	std::vector<op::SearchMonitor*> monitors{optimizer};
+	if (cancelFlag) {
+		const std::atomic<bool>* flag= cancelFlag;
+		monitors.push_back(solver.MakeCustomLimit([flag] () { return flag->load(); }));
+	}
+
+	auto var_strategy= op::Solver::CHOOSE_FIRST_UNBOUND;
+	auto value_strategy= op::Solver::ASSIGN_CENTER_VALUE;
+	if (options.branching == Branching::split) {
+		value_strategy= op::Solver::SPLIT_LOWER_HALF;
+	} else if (options.branching == Branching::splitUpper) {
+		value_strategy= op::Solver::SPLIT_UPPER_HALF;
+	} else if (options.branching == Branching::random) {
+		var_strategy= op::Solver::CHOOSE_RANDOM;
+		value_strategy= op::Solver::ASSIGN_RANDOM_VALUE;
+		solver.ReSeed(options.seed);
+	}
+
+	std::vector<op::IntVar*> solver_vars(vars.begin(), vars.end());
+	auto db= solver.MakePhase(solver_vars, var_strategy, value_strategy);
+	if (shared) {
+		db= solver.Compose(
+				solver.RevAlloc(new detail::RestrictRange(
+						solver_vars[subtree.var], subtree.min, subtree.max)),
+				db);
+	}
+
+	solver.NewSearch(db, monitors);
+	searching= true;
+}
+
+void ConstraintSolver::beginSearch()
+{
+	if (options.objective == Objective::lexicographic)
+		throw std::runtime_error{"Lexicographic objective can't be searched incrementally"};
+	startSearch(weightedObjective(), nullptr, Subtree{});
+}
+
+bool ConstraintSolver::nextSolution(bool keep)
+{
+	ensure(searching && "No ongoing search");
+	if (!solver.NextSolution()) {
+		endSearch();
+		return false;
+	}
+
+	if (keep) {
+		solution.clear();
+		for (auto&& v : vars)
+			solution.push_back(v->Value());
+	}
+	return true;
+}
+
+void ConstraintSolver::endSearch()
+{
+	if (!searching)
+		return;
 	solver.EndSearch();
+	searching= false;
+}
+
+std::int64_t ConstraintSolver::currentValue(std::size_t index) const
+{
+	ensure(searching && "No ongoing search");
+	return vars.get(index).Value();
 }
 
 void ConstraintSolver::addSuccessVar(op::IntVar* success, detail::Priority p)
 {
 	ensure(!p.hard());
 	ensure(success);
-	auto prod= solver.MakeProd(success, p.value())->Var();
-	successAmounts.push_back(prod);
+	successes.emplace_back(p.value(), success);
+}
+
+void ConstraintSolver::postInstr(
+		const Model::Instr& instr,
+		DynArray<op::IntExpr*>& stack,
+		detail::Priority p)
+{
+	auto pop= [&stack] () -> op::IntExpr*
+	{
+		ensure(!stack.empty() && "Invalid program");
+		op::IntExpr* top= stack.back();
+		stack.pop_back();
+		return top;
+	};
+
+	using Op= Model::OpCode;
+	switch (instr.op) {
+		case Op::constant:
+			stack.push_back(solver.MakeIntConst(instr.value.integer));
+		break;
+		case Op::add:
+		case Op::sub:
+		case Op::mul:
+		case Op::div: {
+			op::IntExpr* rhs= pop();
+			op::IntExpr* lhs= pop();
+			ensure(lhs && rhs && "Relation used as a value");
+			if (instr.op == Op::add)
+				stack.push_back(solver.MakeSum(lhs, rhs));
+			else if (instr.op == Op::sub)
+				stack.push_back(solver.MakeDifference(lhs, rhs));
+			else if (instr.op == Op::mul)
+				stack.push_back(solver.MakeProd(lhs, rhs));
+			else
+				stack.push_back(solver.MakeDiv(lhs, rhs));
+		} break;
+		case Op::pos:
+		break;
+		case Op::neg:
+			stack.push_back(solver.MakeOpposite(pop()));
+		break;
+		case Op::eq:
+		case Op::neq:
+		case Op::gr:
+		case Op::ls:
+		case Op::geq:
+		case Op::leq: {
+			op::IntExpr* rhs= pop();
+			op::IntExpr* lhs= pop();
+			ensure(lhs && rhs && "Relation used as a value");
+			if (p.hard()) {
+				solver.AddConstraint(
+						detail::makeConstraint(solver, instr.op, lhs, rhs));
+			} else {
+				addSuccessVar(
+						detail::makeSuccessVar(solver, instr.op, lhs, rhs), p);
+			}
+			stack.push_back(nullptr);
+		} break;
+		case Op::and_:
+			pop();
+			pop();
+			stack.push_back(nullptr);
+		break;
+		default:
+			throw std::runtime_error{"@todo || and ! in ConstraintSolver"};
+	}
 }
 
 } // eq
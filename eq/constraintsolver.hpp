@@ -2,9 +2,14 @@
 #define EQ_CONSTRAINTSOLVER_HPP
 
 #include "expr.hpp"
+#include "model.hpp"
 #include "util.hpp"
 #include "varstorage.hpp"
 
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <limits>
 #include <stdexcept>
 
 #if defined(__DEPRECATED)
@@ -27,11 +32,29 @@ class ConstraintSolver;
 
 namespace detail {
 
+class MaximizeVar;
+
 template <typename T>
 struct MakeConRel {
 	static_assert(!sizeof(T), "Solving for particular expr not implemented");
 };
 
+/// Sum of variables multiplied by coefficients, and a constant
+struct LinearTerms {
+	std::vector<op::IntVar*> vars;
+	std::vector<int64> coeffs;
+	int64 constant= 0;
+};
+
+/// Adds terms of linear expression multiplied by `coeff`
+template <typename T>
+struct CollectTerms {
+	static_assert(!sizeof(T), "Expr isn't linear");
+};
+
+template <typename T>
+struct PostLinear;
+
 class Priority {
 public:
 	static Priority makeHard() { return Priority{}; }
@@ -50,6 +73,17 @@ private:
 	bool hard_= false;
 };
 
+/// Left, bottom, right and top of a rectangle
+using RectVars= std::array<op::IntVar*, 4>;
+
+/// Global constraints with dedicated propagators, see `rect.hpp`
+op::Constraint* makeContains(op::Solver& s, const RectVars& outer, const RectVars& inner);
+op::Constraint* makeDisjoint(op::Solver& s, const RectVars& a, const RectVars& b);
+
+/// @return Boolean var which tells if the relation holds
+op::IntVar* makeContainsVar(op::Solver& s, const RectVars& outer, const RectVars& inner);
+op::IntVar* makeDisjointVar(op::Solver& s, const RectVars& a, const RectVars& b);
+
 } // detail
 
 /// Drawbacks using ConstraintSolver
@@ -57,9 +91,83 @@ private:
 ///   - doesn't handle big ranges very well
 class ConstraintSolver {
 public:
+	using Value= int;
 	static constexpr bool hasPrioritySupport= true;
-
-	void addVar(int& ref);
+	/// Constraints can't be removed from or-tools CP solver
+	static constexpr bool canRetract= false;
+
+	/// How soft relations of different priorities are traded off
+	enum class Objective {
+		/// Maximize sum of priorities of satisfied relations
+		weighted,
+		/// Maximize satisfied relations of each priority in turn,
+		/// starting from the highest. A relation of higher priority is
+		/// never given up for any number of lower ones.
+		lexicographic
+	};
+
+	/// How search picks values for variables
+	enum class Branching {
+		/// Try values starting from the middle of the range
+		center,
+		/// Halve ranges, so that values of big ranges aren't enumerated
+		split,
+		/// Like `split`, but try upper halves first
+		splitUpper,
+		/// Pick variables and values randomly, see `Options::seed`
+		random
+	};
+
+	struct Options {
+		Objective objective= Objective::weighted;
+		Branching branching= Branching::center;
+		/// Domains of `Var<int>` with only hard linear relations are
+		/// solved as mixed integer programs instead, see `Domain::solve`.
+		/// Off by default, as values may differ from the constraint
+		/// solver's when relations allow several solutions
+		bool mixedInteger= false;
+		/// Number of solvers with different strategies racing on separate
+		/// threads. The first one to finish its search is used, and the
+		/// others are cancelled. 1 disables.
+		std::size_t portfolio= 1;
+		int seed= 0;
+		/// Number of threads searching subtrees of the domain in parallel,
+		/// see `solveShared`. Lexicographic objective is searched serially.
+		std::size_t threads= 1;
+	};
+
+	/// Part of the search tree where variable at position `var` is in [min, max]
+	struct Subtree {
+		std::size_t var;
+		int64 min;
+		int64 max;
+	};
+
+	/// Search split between solvers of the same relations
+	/// Subtrees are taken in order by whichever solver is free, so that
+	/// threads which get easy subtrees keep taking more.
+	struct SharedSearch {
+		DynArray<Subtree> subtrees;
+		std::atomic<std::size_t> next{0};
+		/// Best objective found by any solver, which others have to beat
+		std::atomic<int64> best{kint64min};
+	};
+
+	/// @return Options of member `i` of a portfolio of `options`
+	/// First member uses `options` as is, second the other deterministic
+	/// branching, and the rest random branching with different seeds
+	static Options portfolioMember(Options options, std::size_t i);
+
+	ConstraintSolver()= default;
+	explicit ConstraintSolver(Options options)
+		: options(options) { }
+
+	static int minValue() { return minInt; }
+	static int maxValue() { return maxInt; }
+
+	/// @param index Index of the var in the domain
+	void addVar(std::size_t index);
+	void addVar(std::size_t index, std::int64_t min, std::int64_t max);
 
 	template <typename T>
 	void addRelation(Expr<T> rel)
@@ -69,13 +177,66 @@ public:
 	void addRelation(Expr<T> rel, int priority)
 	{ makeRel(rel, detail::Priority{priority}); }
 
-	/// Solve and apply results
+	/// Posts relation given as postfix program, see `Model`
+	/// @param var_index Maps variable index of the program to index of the domain
+	template <typename F>
+	void addProgram(Program program, F&& var_index)
+	{
+		auto p= program.hard() ?	detail::Priority::makeHard() :
+									detail::Priority{program.priority};
+		DynArray<op::IntExpr*> stack;
+		for (auto it= program.begin; it != program.end; ++it) {
+			if (it->op == Model::OpCode::var)
+				stack.push_back(&vars.get(var_index(it->index)));
+			else
+				postInstr(*it, stack, p);
+		}
+		ensure(stack.size() == 1 && "Invalid program");
+	}
+
+	/// Doesn't need anything but the solver, so can be run in any thread
 	/// @todo Make safe for sequential calls
-	void apply();
+	/// @return false if no solution was found, or search was cancelled
+	bool solve();
+
+	/// Propagates relations without searching, and splits the range of
+	/// the first unbound variable, which is where search makes its top
+	/// decisions. Unpropagated ranges are mostly the default limits.
+	/// @return At most `count` subtrees, none if relations fail already
+	DynArray<Subtree> split(std::size_t count);
+
+	/// Searches subtrees of `shared` until there are none left, with
+	/// weighted objective. Solutions have to beat those of other solvers.
+	/// @param best Objective of the best solution of this solver
+	/// @return false if this solver found no solution
+	bool solveShared(SharedSearch& shared, int64& best);
+
+	/// Starts a search of improving solutions of the weighted objective,
+	/// which are taken one at a time with `nextSolution`, see `Domain::solutions`
+	void beginSearch();
+	/// Advances the search of `beginSearch` to the next better solution
+	/// @param keep Copy the solution to `getSolution()`
+	/// @return false if there are no better solutions, which ends the search
+	bool nextSolution(bool keep);
+	/// Ends the search of `beginSearch` early
+	void endSearch();
+	/// Value of var `index` in the solution where the search is
+	std::int64_t currentValue(std::size_t index) const;
+
+	/// Search stops as soon as `flag` is set, from any thread
+	void cancelWhen(const std::atomic<bool>& flag) { cancelFlag= &flag; }
+
+	/// Values of the best solution, indexed like vars
+	/// Stored as 64-bit for `ConstraintSolver64`
+	const DynArray<std::int64_t>& getSolution() const { return solution; }
 
 private:
 	template <typename T>
 	friend class detail::MakeConRel;
+	template <typename T>
+	friend class detail::CollectTerms;
+	template <typename T>
+	friend class detail::PostLinear;
 
 	/// @todo Simplify expression trees so that unsupported operations vanish
 	/// Creates solver constraints matching to expression
@@ -86,15 +247,88 @@ private:
 
 	void addSuccessVar(op::IntVar* success, detail::Priority p);
 
+	/// Applies non-variable instruction of a program to the expression stack
+	/// Relations are posted and replaced by null
+	void postInstr(	const Model::Instr& instr,
+					DynArray<op::IntExpr*>& stack,
+					detail::Priority p);
+
 	// Completely arbitrary
 	/// @todo Remove limits
 	static constexpr int minInt= -9999;
 	static constexpr int maxInt= 9999;
 
+	/// Sum of priorities of satisfied soft relations
+	op::IntVar* weightedObjective();
+
+	/// Searches for solution maximizing `objective`
+	/// @param best Value of `objective` in the solution
+	/// @param shared Bound shared with other solvers, or null
+	/// @param subtree Part of the tree to search if `shared` isn't null
+	bool search(op::IntVar* objective, int64& best,
+				SharedSearch* shared= nullptr, Subtree subtree= Subtree{});
+
+	/// Starts search which is advanced by `nextSolution`, see `search`
+	void startSearch(op::IntVar* objective, SharedSearch* shared, Subtree subtree);
+	bool cancelled() const { return cancelFlag && cancelFlag->load(); }
+
+	/// Optimizes priorities one at a time, fixing the optimum of each
+	bool solveLexicographic();
+
+	Options options;
+	const std::atomic<bool>* cancelFlag= nullptr;
 	op::Solver solver{"solver"};
-	VarStorage<int, op::IntVar> vars;
+	VarStorage<op::IntVar> vars;
 	/// Priorization is implemented by maximizing success of constraints
-	DynArray<op::IntVar*> successAmounts;
+	/// Pairs of priority and boolean success variable
+	DynArray<std::pair<int, op::IntVar*>> successes;
+	DynArray<std::int64_t> solution;
+	/// Objective of the ongoing search
+	detail::MaximizeVar* optimizer= nullptr;
+	bool searching= false;
+};
+
+/// ConstraintSolver for `Var<std::int64_t>`
+/// Variables keep only bounds for big ranges and search splits ranges
+/// in halves, so that e.g. timestamps don't blow up memory or search time
+class ConstraintSolver64 : public ConstraintSolver {
+public:
+	using Value= std::int64_t;
+
+	/// Half of int64 range, so that sums of two don't overflow
+	static std::int64_t minValue() { return std::numeric_limits<std::int64_t>::min()/2; }
+	static std::int64_t maxValue() { return std::numeric_limits<std::int64_t>::max()/2; }
+
+	ConstraintSolver64()
+		: ConstraintSolver64(Options{}) { }
+
+	/// Branching is `split` instead of `center`
+	explicit ConstraintSolver64(Options options)
+		: ConstraintSolver(withSplit(options)) { }
+
+	/// Center branching of the base would be split as well, so the
+	/// second member splits towards the other end instead
+	static Options portfolioMember(Options options, std::size_t i)
+	{
+		Options member= ConstraintSolver::portfolioMember(withSplit(options), i);
+		if (i == 1) {
+			member.branching= withSplit(options).branching == Branching::split ?
+				Branching::splitUpper : Branching::split;
+		}
+		return member;
+	}
+
+	using ConstraintSolver::addVar;
+	void addVar(std::size_t index)
+	{ ConstraintSolver::addVar(index, minValue(), maxValue()); }
+
+private:
+	static Options withSplit(Options options)
+	{
+		if (options.branching == Branching::center)
+			options.branching= Branching::split;
+		return options;
+	}
 };
 
 
@@ -115,7 +349,7 @@ template <typename T, VarType type>
 struct MakeConRel<Var<T, type>> {
 	static op::IntVar* eval(ConstraintSolver& self, Var<T, type>& v, Priority p)
 	{
-		return self.vars.getInfo(v.get()).model;
+		return &self.vars.get(v.getIndex());
 	}
 };
 
@@ -180,11 +414,143 @@ struct MakeConRel<UOp<T, Neg>> {
 	}
 };
 
+/// Posted as one sum or scalar product of the terms
+template <typename E, typename C>
+struct MakeConRel<Sum<E, C>> {
+	static op::IntExpr* eval(ConstraintSolver& self, Sum<E, C> e, Priority p)
+	{
+		std::vector<op::IntVar*> vars;
+		vars.reserve(e.size());
+		for (std::size_t i= 0; i < e.size(); ++i) {
+			E term= e.term(i);
+			vars.push_back(self.makeRel(term, p)->Var());
+		}
+		if (!e.coeffs)
+			return self.solver.MakeSum(vars);
+
+		std::vector<int64> coeffs(e.coeffs->begin(), e.coeffs->end());
+		return self.solver.MakeScalProd(vars, coeffs);
+	}
+};
+
+template <typename T>
+struct CollectTerms<Expr<T>> {
+	static void eval(ConstraintSolver& self, Expr<T> e, int64 coeff, LinearTerms& terms)
+	{ CollectTerms<T>::eval(self, e.get(), coeff, terms); }
+};
+
+template <typename T, VarType type>
+struct CollectTerms<Var<T, type>> {
+	static void eval(ConstraintSolver& self, Var<T, type>& v, int64 coeff, LinearTerms& terms)
+	{
+		terms.vars.push_back(&self.vars.get(v.getIndex()));
+		terms.coeffs.push_back(coeff);
+	}
+};
+
+template <typename T>
+struct CollectTerms<Constant<T>> {
+	static void eval(ConstraintSolver&, Constant<T> c, int64 coeff, LinearTerms& terms)
+	{ terms.constant += coeff*c.get(); }
+};
+
+template <typename T>
+struct CollectTerms<UOp<T, Pos>> {
+	static void eval(ConstraintSolver& self, UOp<T, Pos> op, int64 coeff, LinearTerms& terms)
+	{ CollectTerms<T>::eval(self, op.e, coeff, terms); }
+};
+
+template <typename T>
+struct CollectTerms<UOp<T, Neg>> {
+	static void eval(ConstraintSolver& self, UOp<T, Neg> op, int64 coeff, LinearTerms& terms)
+	{ CollectTerms<T>::eval(self, op.e, -coeff, terms); }
+};
+
+template <typename T1, typename T2>
+struct CollectTerms<BiOp<T1, T2, Add>> {
+	static void eval(ConstraintSolver& self, BiOp<T1, T2, Add> op, int64 coeff, LinearTerms& terms)
+	{
+		CollectTerms<T1>::eval(self, op.lhs, coeff, terms);
+		CollectTerms<T2>::eval(self, op.rhs, coeff, terms);
+	}
+};
+
+template <typename T1, typename T2>
+struct CollectTerms<BiOp<T1, T2, Sub>> {
+	static void eval(ConstraintSolver& self, BiOp<T1, T2, Sub> op, int64 coeff, LinearTerms& terms)
+	{
+		CollectTerms<T1>::eval(self, op.lhs, coeff, terms);
+		CollectTerms<T2>::eval(self, op.rhs, -coeff, terms);
+	}
+};
+
+/// One side is constant, which is evaluated to a coefficient
+template <typename T1, typename T2>
+struct CollectTerms<BiOp<T1, T2, Mul>> {
+	static void eval(ConstraintSolver& self, BiOp<T1, T2, Mul> op, int64 coeff, LinearTerms& terms)
+	{ eval(self, op, coeff, terms, std::integral_constant<bool, degree<T1>() == 0>{}); }
+
+	static void eval(	ConstraintSolver& self, BiOp<T1, T2, Mul> op, int64 coeff,
+						LinearTerms& terms, std::true_type /*lhs constant*/)
+	{ CollectTerms<T2>::eval(self, op.rhs, coeff*op.lhs.eval(), terms); }
+
+	static void eval(	ConstraintSolver& self, BiOp<T1, T2, Mul> op, int64 coeff,
+						LinearTerms& terms, std::false_type /*lhs constant*/)
+	{ CollectTerms<T1>::eval(self, op.lhs, coeff*op.rhs.eval(), terms); }
+};
+
+template <typename E, typename C>
+struct CollectTerms<Sum<E, C>> {
+	static void eval(ConstraintSolver& self, Sum<E, C> e, int64 coeff, LinearTerms& terms)
+	{
+		terms.vars.reserve(terms.vars.size() + e.size());
+		terms.coeffs.reserve(terms.coeffs.size() + e.size());
+		for (std::size_t i= 0; i < e.size(); ++i)
+			CollectTerms<E>::eval(self, e.term(i), coeff*e.coeff(i), terms);
+	}
+};
+
+template <typename E>
+using LinearTag= std::integral_constant<bool, isLinear<E>()>;
+
+/// Posts `sum <op> bound`
+inline op::Constraint* makeScalProd(op::Solver& s, const LinearTerms& t, int64 bound, Eq)
+{ return s.MakeScalProdEquality(t.vars, t.coeffs, bound); }
+inline op::Constraint* makeScalProd(op::Solver& s, const LinearTerms& t, int64 bound, Geq)
+{ return s.MakeScalProdGreaterOrEqual(t.vars, t.coeffs, bound); }
+inline op::Constraint* makeScalProd(op::Solver& s, const LinearTerms& t, int64 bound, Leq)
+{ return s.MakeScalProdLessOrEqual(t.vars, t.coeffs, bound); }
+inline op::Constraint* makeScalProd(op::Solver& s, const LinearTerms& t, int64 bound, Gr)
+{ return s.MakeScalProdGreaterOrEqual(t.vars, t.coeffs, bound + 1); }
+inline op::Constraint* makeScalProd(op::Solver& s, const LinearTerms& t, int64 bound, Ls)
+{ return s.MakeScalProdLessOrEqual(t.vars, t.coeffs, bound - 1); }
+
+/// Posts hard linear comparison as one scalar product constraint
+/// instead of a tree of intermediate sum and product expressions
+template <typename T1, typename T2, typename Op>
+struct PostLinear<BiOp<T1, T2, Op>> {
+	/// @return false if `op` isn't linear, and has to be posted generally
+	static bool eval(ConstraintSolver& self, BiOp<T1, T2, Op> op, std::true_type /*linear*/)
+	{
+		// lhs - rhs + constant <op> 0
+		LinearTerms terms;
+		CollectTerms<T1>::eval(self, op.lhs, 1, terms);
+		CollectTerms<T2>::eval(self, op.rhs, -1, terms);
+		self.solver.AddConstraint(makeScalProd(self.solver, terms, -terms.constant, Op{}));
+		return true;
+	}
+
+	static bool eval(ConstraintSolver&, BiOp<T1, T2, Op>, std::false_type /*linear*/)
+	{ return false; }
+};
+
 template <typename T1, typename T2>
 struct MakeConRel<BiOp<T1, T2, Eq>> {
 	static void eval(ConstraintSolver& self, BiOp<T1, T2, Eq> op, Priority p)
 	{
 		if (p.hard()) {
+			if (PostLinear<BiOp<T1, T2, Eq>>::eval(self, op, LinearTag<BiOp<T1, T2, Eq>>{}))
+				return;
 			auto cst= self.solver.MakeEquality(	self.makeRel(op.lhs, p),
 												self.makeRel(op.rhs, p));
 			self.solver.AddConstraint(cst);
@@ -219,6 +585,8 @@ struct MakeConRel<BiOp<T1, T2, Gr>> {
 	static void eval(ConstraintSolver& self, BiOp<T1, T2, Gr> op, Priority p)
 	{
 		if (p.hard()) {
+			if (PostLinear<BiOp<T1, T2, Gr>>::eval(self, op, LinearTag<BiOp<T1, T2, Gr>>{}))
+				return;
 			auto constraint= self.solver.MakeGreater(	self.makeRel(op.lhs, p),
 														self.makeRel(op.rhs, p));
 			self.solver.AddConstraint(constraint);
@@ -236,6 +604,8 @@ struct MakeConRel<BiOp<T1, T2, Ls>> {
 	static void eval(ConstraintSolver& self, BiOp<T1, T2, Ls> op, Priority p)
 	{
 		if (p.hard()) {
+			if (PostLinear<BiOp<T1, T2, Ls>>::eval(self, op, LinearTag<BiOp<T1, T2, Ls>>{}))
+				return;
 			auto constraint= self.solver.MakeLess(	self.makeRel(op.lhs, p),
 													self.makeRel(op.rhs, p));
 			self.solver.AddConstraint(constraint);
@@ -253,6 +623,8 @@ struct MakeConRel<BiOp<T1, T2, Geq>> {
 	static void eval(ConstraintSolver& self, BiOp<T1, T2, Geq> op, Priority p)
 	{
 		if (p.hard()) {
+			if (PostLinear<BiOp<T1, T2, Geq>>::eval(self, op, LinearTag<BiOp<T1, T2, Geq>>{}))
+				return;
 			auto constraint= self.solver.MakeGreaterOrEqual(self.makeRel(op.lhs, p),
 															self.makeRel(op.rhs, p));
 			self.solver.AddConstraint(constraint);
@@ -270,6 +642,8 @@ struct MakeConRel<BiOp<T1, T2, Leq>> {
 	static void eval(ConstraintSolver& self, BiOp<T1, T2, Leq> op, Priority p)
 	{
 		if (p.hard()) {
+			if (PostLinear<BiOp<T1, T2, Leq>>::eval(self, op, LinearTag<BiOp<T1, T2, Leq>>{}))
+				return;
 			auto constraint= self.solver.MakeLessOrEqual(	self.makeRel(op.lhs, p),
 															self.makeRel(op.rhs, p));
 			self.solver.AddConstraint(constraint);
@@ -3,172 +3,1261 @@
 
 #include "basevar.hpp"
 #include "constraintsolver.hpp"
+#include "executor.hpp"
+#include "incrementalsolver.hpp"
 #include "linearsolver.hpp"
+#include "model.hpp"
+#include "pool.hpp"
+#include "refptr.hpp"
+#include "relstorage.hpp"
 #include "util.hpp"
 #include "varhandle.hpp"
 
+#include <atomic>
+#include <cmath>
+#include <functional>
+#include <future>
+#include <iterator>
+#include <mutex>
+
 namespace eq {
-class BaseDomain : public std::enable_shared_from_this<BaseDomain> {
+
+/// Solver which has produced the values of a domain
+enum class Backend {
+	/// Not solved yet
+	none,
+	/// Priorities ordered only by `<` and `>`, solved without a solver
+	ordering,
+	constraint,
+	linear,
+	/// Integer domain of linear relations solved by LinearSolver
+	mixedInteger,
+	/// Linear domain with edited variables, see `eq::beginEdit`
+	incremental
+};
+
+namespace detail {
+
+template <typename S>
+struct BackendOf { static constexpr Backend value= Backend::constraint; };
+template <>
+struct BackendOf<LinearSolver> { static constexpr Backend value= Backend::linear; };
+
+} // detail
+
+/// Owned by variables through BaseDomainPtr
+class BaseDomain : public RefCounted {
+public:
+	virtual ~BaseDomain()= default;
+
+	/// Removes relation of a handle, see `RelHandle::remove`
+	virtual void removeRel(detail::RelHeader& rec)= 0;
+
+	/// Held while the domain is modified or solved through `rel`, `Var`
+	/// and `RelHandle`, so that independent domains can be built in
+	/// parallel. Lock with `detail::DomainsLock` or `detail::lockDomainOf`.
+	std::mutex& getMutex() { return mutex; }
+
+private:
+	std::mutex mutex;
 };
 
 template <typename S>
 class Domain;
 
 template <typename S>
-using DomainPtr= SharedPtr<Domain<S>>;
+using DomainPtr= RefPtr<Domain<S>>;
 
 template <typename S>
 class Domain : public BaseDomain {
 public:
 	using Solver= S;
+	using Value= typename Solver::Value;
 	static int maxPriorityCount() { return 1024; }
 
-	Domain()= default;
+	Domain()
+		: rels(*this) { }
 	Domain(const Domain&)= delete;
 	Domain(Domain&&)= delete;
 	Domain& operator=(const Domain&)= delete;
 	Domain& operator=(Domain&&)= delete;
 
+	/// Domains are recycled, because merging frees all but one
+	static void* operator new(std::size_t size)
+	{
+		ensure(size == sizeof(Domain));
+		return detail::FreeList<sizeof(Domain)>::allocate();
+	}
+	static void operator delete(void* p)
+	{ detail::FreeList<sizeof(Domain)>::deallocate(p); }
+
 	template <typename T, VarType type>
 	void addVar(Var<T, type>& var)
 	{
-		VarHandle handle{var};
-		varInfos.emplace_back(
-			VarInfo{
-				handle,
-				[handle] (Domain& d, Solver& solver)
-				{
-					ensure(handle && "Invalid eq::Var handle");
-					Var<T, type>& var= static_cast<Var<T, type>&>(handle.get());
-					solver.addVar(var.get());
-				}
-			}
-		);
+		static_assert(isSame<T, Value>(), "Var type doesn't match solver");
+		var.setIndex(values.size());
+		vars.emplace_back(var);
+		values.push_back(Value{});
 
 		limitRange(var);
 		
-		dirty= true;
+		invalidate();
 	}
 
 	/// Removes `var` from domain and all relations where `var` is present
 	/// Doesn't need to be called on move because handles are smart
+	/// Last variable takes the place of `var`, so indices aren't stable
 	void removeVar(BaseVar& var)
 	{
-		eraseIf(varInfos,
-			[&var] (const VarInfo& info)
-			{ return &info.handle.get() == &var; }); 
+		std::size_t i= var.getIndex();
+		ensure(i < vars.size() && &vars[i].get() == &var && "Var not in domain");
+		if (i + 1 != vars.size()) {
+			vars[i]= std::move(vars.back());
+			values[i]= values.back();
+			vars[i]->setIndex(i);
+		}
+		vars.pop_back();
+		values.pop_back();
+		++layout;
 
-		eraseIf(relInfos,
-			[&var] (const RelInfo& info)
-			{
-				for (auto&& h : info.vars) {
-					if (&h.get() == &var)
-						return true;
-				}
-				return false;
-			});
+		rels.eraseReferring(var);
+		eraseIf(edits, [&var] (const Edit& e) { return &e.first.get() == &var; });
 
 		/// @todo Not always necessary
-		dirty= true;
+		invalidate();
 	}
 
+	/// Posted also directly to the retained solver if there's one
 	template <typename T>
-	void addRelation(Expr<T> rel)
+	RelHandle addRelation(Expr<T> rel)
 	{
-		relInfos.emplace_back(
-			RelInfo{
-				asHandles(rel.getVars()),
-				[rel] (Domain& d, Solver& solver)
-				{
-					solver.addRelation(rel);
-				}
-			}
-		);
-		dirty= true;
+		RelHandle handle;
+		rels.add(HardRel<Expr<T>>{rel}, &handle);
+		if (live)
+			postLive(rel, handle, std::integral_constant<bool, Solver::canRetract>{});
+		else if (editor)
+			postModel(*editor, rel, handle);
+		else if (mip)
+			postMip(rel, handle, std::integral_constant<bool, isLinear<Expr<T>>()>{});
+		else
+			invalidate();
+		return handle;
 	}
 
 	template <typename T1, typename T2>
-	void addRelation(Expr<T1> rel, Var<T2, VarType::priority>& priority)
+	RelHandle addRelation(Expr<T1> rel, Var<T2, VarType::priority>& priority)
 	{
 		static_assert(sizeof(T1) && Solver::hasPrioritySupport, "Solver doesn't have priority support");
-		VarHandle priority_h{priority};
-		relInfos.emplace_back(
-			RelInfo {
-				asHandles(rel.getVars()),
-				[rel, priority_h] (Domain& d, Solver& solver)
-				{
-					ensure(priority_h && "eq::PriorityVar has been destroyed");
-					Var<T2, VarType::priority>& p=
-						static_cast<Var<T2, VarType::priority>&>(priority_h.get());
-					// This will solve priority domain
-					solver.addRelation(rel, p);
-				}
-			}
-		);
+		RelHandle handle;
+		rels.add(SoftRel<Expr<T1>, Var<T2, VarType::priority>>{rel, VarHandle{priority}}, &handle);
+		invalidate();
+		return handle;
+	}
+
+	/// Retracts the relation from the retained solver if the solver
+	/// supports it, so that solving doesn't need to rebuild everything
+	void removeRel(detail::RelHeader& rec) override
+	{
+		ensure(rec.handle);
+		if (live)
+			retract(*rec.handle, std::integral_constant<bool, Solver::canRetract>{});
+		else if (editor)
+			editor->retract(rec.handle->liveBegin, rec.handle->liveEnd);
+		else if (mip)
+			retractMip(*rec.handle);
+		rels.erase(rec);
+		dirty= true;
+		++revision;
+	}
+
+	/// Adds relation given as postfix program
+	/// @param storage Owner of the instructions
+	/// @param vars Variables referred by the program, of type V
+	template <typename V>
+	void addProgram(
+			Program program,
+			SharedPtr<const void> storage,
+			SharedPtr<const DynArray<VarHandle>> vars)
+	{
+		rels.add(ProgramRel<V>{program, std::move(storage), std::move(vars)});
+		invalidate();
+	}
+
+	/// Makes `var` follow `suggestValue`, starting from its current value
+	/// While some variable is edited, the domain is solved by an
+	/// IncrementalSolver which is kept in sync with relations, so that
+	/// neither suggesting values nor changing relations rebuilds it.
+	void beginEdit(BaseVar& var)
+	{
+		static_assert(sizeof(S) && isSame<Solver, LinearSolver>(),
+				"Only domains of LinearSolver can be edited");
+		ensure(&var.getDomain() == this && "Var not in domain");
+		if (findEdit(var) != edits.end())
+			return;
+
+		Value value= values[var.getIndex()];
+		edits.emplace_back(VarHandle{var}, value);
+		if (editor) {
+			editor->addEditVar(var.getIndex());
+			editor->suggestValue(var.getIndex(), value);
+		}
 		dirty= true;
 	}
 
+	/// Next solve moves `var` as close to `value` as relations allow
+	void suggestValue(BaseVar& var, Value value)
+	{
+		auto it= findEdit(var);
+		ensure(it != edits.end() && "Var isn't edited");
+		it->second= value;
+		if (editor)
+			editor->suggestValue(var.getIndex(), value);
+		dirty= true;
+	}
+
+	/// Other edited variables may move once `var` is free. When the last
+	/// edit ends, current values are kept, and later solves use `Solver`.
+	void endEdit(BaseVar& var)
+	{
+		auto it= findEdit(var);
+		if (it == edits.end())
+			return;
+		if (edits.size() == 1) {
+			// Kept values have to include changes since the last solve
+			if (dirty)
+				solveEdited(std::integral_constant<bool, isSame<Solver, LinearSolver>()>{});
+			edits.clear();
+			editor.reset();
+			return;
+		}
+
+		edits.erase(it);
+
+		if (editor)
+			editor->removeEditVar(var.getIndex());
+		dirty= true;
+	}
+
+	std::size_t varCount() const { return vars.size(); }
+	/// Changes whenever variables or relations change
+	std::size_t getRevision() const { return revision; }
+	/// Like revision, but `restore` brings back that of the checkpoint
+	std::size_t getState() const { return revision - undone; }
+
+	/// Options for solvers of the domain
+	/// Merging keeps the options of the domain which is merged into
+	void setOptions(const typename Solver::Options& o)
+	{
+		options= o;
+		invalidate();
+	}
+	const typename Solver::Options& getOptions() const { return options; }
+	/// Chosen when solving by the structure of relations
+	/// Background solves choose the same way
+	Backend getBackend() const { return backend; }
+	std::size_t relCount() const { return rels.size(); }
+
+	/// Current values of variables, indexed by `BaseVar::getIndex`
+	/// Stored contiguously so that solutions are applied in one pass
+	/// and can be read in blocks. Invalidated by adding variables.
+	const DynArray<Value>& getValues() const { return values; }
+	Value& getValue(std::size_t i) { ensure(i < values.size()); return values[i]; }
+
+	/// Sets values of variables without solving
+	/// @param seeded Variables of the domain, corresponding to `seed_values`
+	/// @param solved True if values are known to be the solution
+	///               of current relations
+	void seed(	const DynArray<VarHandle>& seeded,
+				const Value* seed_values,
+				bool solved)
+	{
+		for (std::size_t i= 0; i < seeded.size(); ++i) {
+			auto&& var= seeded[i].get();
+			ensure(&var.getDomain() == this && "Var not in domain");
+			values[var.getIndex()]= seed_values[i];
+		}
+
+		if (solved) {
+			pending.reset();
+			dirty= false;
+			publish();
+		}
+	}
+
+	/// Solution and state of the domain, see `restore`
+	struct Checkpoint {
+		DynArray<Value> values;
+		std::size_t state;
+		bool solved;
+	};
+
+	/// Doesn't solve. Unfinished solution isn't saved.
+	Checkpoint checkpoint() const
+	{ return Checkpoint{values, getState(), !dirty && !pending}; }
+
+	/// Brings back the solution of a checkpoint, so that there's no need
+	/// to solve again after temporary changes have been undone
+	/// Variables and relations must be the same as at the time of `cp`.
+	/// Revision moves forward as values change, state goes back to `cp`.
+	void restore(Checkpoint cp)
+	{
+		ensure(cp.values.size() == values.size());
+		values= std::move(cp.values);
+		++revision;
+		undone= revision - cp.state;
+		if (cp.solved) {
+			pending.reset();
+			dirty= false;
+			publish();
+		}
+	}
+
+	/// Values of a solution, which don't change after publishing
+	struct Snapshot {
+		/// Indexed by `BaseVar::getIndex` at the time of solving
+		DynArray<Value> values;
+		std::size_t revision;
+		/// Changes when indices of variables change, see `layout`
+		std::size_t layout;
+	};
+
+	/// Latest solved values. Safe to call from any thread while the owning
+	/// thread edits relations and solves, as snapshots are replaced and not
+	/// modified. Readers never wait for solving.
+	/// Doesn't solve, so the snapshot may be older than current relations.
+	SharedPtr<const Snapshot> snapshot() const
+	{
+		static_assert(sizeof(S) && detail::atomicRefCount,
+				"Sharing domains between threads requires EQ_ATOMIC_REFCOUNT");
+		return std::atomic_load(&published);
+	}
+
+	/// @return Object-independent copy of variables and relations
+	/// Soft relations get current values of their priorities
+	Model exportModel()
+	{
+		DynArray<const BaseVar*> order;
+		for (auto&& h : vars)
+			order.push_back(&h.get());
+		return exportModel(order);
+	}
+
+	/// @param order Variables of the domain in the order of the model
+	Model exportModel(const DynArray<const BaseVar*>& order)
+	{
+		ensure(order.size() == vars.size() && "Order doesn't cover the domain");
+		detail::ModelWriter w{Model::typeOf<Value>()};
+		for (auto&& var : order)
+			w.addVar(*var, Solver::minValue(), Solver::maxValue());
+		rels.emit(w);
+		return std::move(w.getModel());
+	}
+
+	/// Solves synchronously if solution isn't up-to-date
+	/// Waits for a background solve if it is up-to-date
 	void solve()
+	{
+		if (!dirty) {
+			if (pending) {
+				wait(*pending->task);
+				commit();
+			}
+			return;
+		}
+
+		// Background solve would be outdated
+		pending.reset();
+		solveNow();
+		publish();
+	}
+
+	/// Whether `solutions()` writes the best solution to variables
+	enum class Commit {
+		/// Variables aren't touched, solutions are only streamed
+		none,
+		/// Last solution is committed when the stream ends, like by `solve()`
+		last
+	};
+
+	class Solutions;
+
+	/// Solution where the search of `solutions()` is
+	/// Values are read from the solver, so a solution is valid only until
+	/// the stream advances
+	class Solution {
+	public:
+		/// Position in the stream, starting from 0
+		std::size_t number() const { return count; }
+
+		Value operator[](const BaseVar& var) const
+		{
+			ensure(&var.getDomain() == domain && "Var not in domain");
+			return static_cast<Value>(solver->currentValue(var.getIndex()));
+		}
+
+	private:
+		friend class Solutions;
+
+		const BaseDomain* domain;
+		const Solver* solver;
+		std::size_t count;
+	};
+
+	/// Input range of improving solutions, which are searched only as the
+	/// range is iterated. Relations must not change while it exists.
+	class Solutions {
+	public:
+		class Iterator : public std::iterator<std::input_iterator_tag, const Solution> {
+		public:
+			const Solution& operator*() const { return stream->current; }
+			const Solution* operator->() const { return &stream->current; }
+			Iterator& operator++()
+			{
+				stream->advance();
+				return *this;
+			}
+
+			bool operator==(const Iterator& other) const { return atEnd() == other.atEnd(); }
+			bool operator!=(const Iterator& other) const { return atEnd() != other.atEnd(); }
+
+		private:
+			friend class Solutions;
+			explicit Iterator(Solutions* s)
+				: stream(s) { }
+
+			bool atEnd() const { return !stream || stream->finished; }
+
+			Solutions* stream;
+		};
+
+		Solutions(Solutions&&)= default;
+		~Solutions()
+		{
+			if (solver && !finished)
+				solver->endSearch();
+		}
+
+		/// Searches the first solution
+		Iterator begin()
+		{
+			ensure(!begun && "Solutions can be iterated only once");
+			begun= true;
+			advance();
+			return Iterator{this};
+		}
+
+		Iterator end() { return Iterator{nullptr}; }
+
+	private:
+		friend class Domain;
+
+		Solutions(Domain& d, UniquePtr<Solver> s, Commit c)
+			: domain(&d)
+			, solver(std::move(s))
+			, commit(c)
+			, revision(d.revision)
+		{
+			current.domain= domain;
+			current.solver= solver.get();
+			current.count= 0;
+		}
+
+		void advance()
+		{
+			ensure(!finished);
+			if (found)
+				++current.count;
+			if (solver->nextSolution(commit == Commit::last)) {
+				found= true;
+				return;
+			}
+
+			finished= true;
+			if (found && commit == Commit::last && domain->revision == revision)
+				domain->commitFinal(*solver);
+		}
+
+		Domain* domain;
+		UniquePtr<Solver> solver;
+		Commit commit;
+		/// Revision of the domain when posted
+		std::size_t revision;
+		Solution current;
+		bool begun= false;
+		bool found= false;
+		bool finished= false;
+	};
+
+	/// Streams improving solutions as they are found, e.g. for showing
+	/// progress, without writing them to the variables
+	/// Only for ConstraintSolver with weighted objective.
+	Solutions solutions(Commit commit= Commit::none)
+	{
+		static_assert(	std::is_base_of<ConstraintSolver, Solver>::value,
+						"Solver doesn't stream solutions");
+		UniquePtr<Solver> solver{new Solver{options}};
+		post(*solver);
+		solver->beginSearch();
+		return Solutions{*this, std::move(solver), commit};
+	}
+
+	/// Starts solving in a background thread if solution isn't up-to-date
+	/// Results are committed to variables by `poll()` or `solve()`
+	/// Backend is chosen like in `solve()`. Edited domains are solved right
+	/// away, which takes only a few pivots.
+	void solveAsync()
 	{
 		if (!dirty)
 			return;
 
-		Solver solver;
-		for (auto&& info : varInfos)
-			info.post(*this, solver);
-		for (auto&& info : relInfos)
-			info.post(*this, solver);
-		solver.apply();
+		pending.reset();
+		if (	solveEdited(std::integral_constant<bool, isSame<Solver, LinearSolver>()>{}) ||
+				solveOrdering()) {
+			publish();
+			return;
+		}
 
+		// Posting is done here because relations refer to variables,
+		// which are free to change in this thread during solving
+		auto task= std::make_shared<AsyncTask>();
+		task->job= mixedIntegerJob(std::integral_constant<bool, isSame<Solver, ConstraintSolver>()>{});
+		backend= Backend::mixedInteger;
+		if (!task->job) {
+			task->job= searchJob(std::is_base_of<ConstraintSolver, Solver>{});
+			backend= Backend::constraint;
+		}
+		if (!task->job) {
+			task->job= solverJob();
+			backend= detail::BackendOf<Solver>::value;
+		}
+		pending.reset(new AsyncSolve{vars, layout, task});
 		dirty= false;
+
+		Executor::global().push([task] ()
+		{
+			bool found= task->job(task->solution);
+
+			std::lock_guard<std::mutex> lock(task->mutex);
+			task->found= found;
+			task->finished= true;
+			for (auto&& w : task->waiting)
+				fulfill(*task, w.first, w.second);
+			task->waiting.clear();
+			task->finishedCond.notify_all();
+		});
+	}
+
+	/// Commits results of a finished background solve, and starts a new one
+	/// if relations have changed. Never blocks.
+	void poll()
+	{
+		if (pending && isFinished(*pending->task))
+			commit();
+
+		// Only one background solve at a time, so that rapidly changing
+		// relations don't pile up solves which would be outdated anyway
+		if (dirty && !pending)
+			solveAsync();
+	}
+
+	/// @return Value of `var` after all current relations have been solved
+	template <typename T, VarType type>
+	std::future<T> valueAsync(const Var<T, type>& var)
+	{
+		static_assert(isSame<T, Value>(), "Var type doesn't match solver");
+		poll();
+		if (dirty)
+			solveAsync();
+
+		std::promise<T> promise;
+		auto future= promise.get_future();
+		if (!pending) {
+			promise.set_value(values[var.getIndex()]);
+			return future;
+		}
+
+		// Layout can't have changed because that would have made solve outdated
+		ensure(pending->layout == layout);
+		std::size_t index= var.getIndex();
+
+		auto&& task= *pending->task;
+		std::lock_guard<std::mutex> lock(task.mutex);
+		if (task.finished)
+			fulfill(task, index, promise);
+		else
+			task.waiting.emplace_back(index, std::move(promise));
+		return future;
 	}
 
 	void merge(Domain&& other)
 	{
 		ensure(this != &other);
 
-		varInfos= varInfos + other.varInfos;
-		for (auto&& info : other.varInfos)
-			info.handle->setDomainPtr(shared_from_this());
+		BaseDomainPtr self{this};
+		for (std::size_t i= 0; i < other.vars.size(); ++i) {
+			auto&& h= other.vars[i];
+			h->setDomainPtr(self);
+			h->setIndex(vars.size());
+			vars.push_back(h);
+			values.push_back(other.values[i]);
+		}
 	
-		relInfos= relInfos + other.relInfos;
+		rels.append(std::move(other.rels));
+		edits.insert(edits.end(), other.edits.begin(), other.edits.end());
 	
-		dirty= true;
+		invalidate();
 		other.clear();
 	}
 
 	void clear()
 	{
-		varInfos.clear();
-		relInfos.clear();
+		vars.clear();
+		values.clear();
+		++layout;
+		rels.clear();
+		pending.reset();
+		live.reset();
+		mip.reset();
+		edits.clear();
+		editor.reset();
+		backend= Backend::none;
 		dirty= false;
+		++revision;
+		publish();
 	}
 
 private:
-	using AddRel= std::function<void (Domain& d, Solver& solver)>;
-	using AddVar= std::function<void (Domain& d, Solver& solver)>;
+	/// Records of posted relations for future reposting
+	/// Handles inside expressions keep track of the variables,
+	/// so there's no need to store them separately
+
+	template <typename E>
+	struct HardRel {
+		E rel;
+
+		void post(Solver& solver) const
+		{ solver.addRelation(rel); }
 
-	struct VarInfo {
-		VarHandle handle;
-		AddVar post;
+		bool refersTo(const BaseVar& var) const
+		{ return rel.refersTo(var); }
+
+		void emit(detail::ModelWriter& w) const
+		{ emitRel(w, rel, Model::hard); }
+
+		bool collectOrdering(detail::Ordering& o) const
+		{ return detail::CollectOrdering<E>::eval(rel, o); }
+
+		bool linear() const { return isLinear<E>(); }
 	};
 
-	struct RelInfo {
+	template <typename E, typename P>
+	struct SoftRel {
+		E rel;
+		VarHandle priority;
+
+		void post(Solver& solver) const
+		{
+			ensure(priority && "eq::PriorityVar has been destroyed");
+			// This will solve priority domain
+			solver.addRelation(rel, static_cast<P&>(priority.get()));
+		}
+
+		bool refersTo(const BaseVar& var) const
+		{ return rel.refersTo(var); }
+
+		void emit(detail::ModelWriter& w) const
+		{
+			ensure(priority && "eq::PriorityVar has been destroyed");
+			emitRel(w, rel, static_cast<P&>(priority.get()));
+		}
+
+		bool collectOrdering(detail::Ordering&) const
+		{ return false; }
+
+		bool linear() const { return false; }
+	};
+
+	/// Relation of a loaded model
+	template <typename V>
+	struct ProgramRel {
+		Program program;
+		SharedPtr<const void> storage;
+		SharedPtr<const DynArray<VarHandle>> vars;
+
+		void post(Solver& solver) const
+		{
+			auto&& vs= *vars;
+			solver.addProgram(program,
+				[&vs] (std::uint32_t i) -> std::size_t
+				{
+					ensure(vs[i] && "Invalid eq::Var handle");
+					return vs[i]->getIndex();
+				});
+		}
+
+		bool refersTo(const BaseVar& var) const
+		{
+			for (auto it= program.begin; it != program.end; ++it) {
+				if (it->op != Model::OpCode::var)
+					continue;
+				auto&& h= (*vars)[it->index];
+				if (h && &h.get() == &var)
+					return true;
+			}
+			return false;
+		}
+
+		void emit(detail::ModelWriter& w) const
+		{
+			w.beginRel();
+			for (auto it= program.begin; it != program.end; ++it) {
+				if (it->op == Model::OpCode::var)
+					w.var((*vars)[it->index].get());
+				else
+					w.copy(*it);
+			}
+			w.endRel(program.priority);
+		}
+
+		bool collectOrdering(detail::Ordering&) const
+		{ return false; }
+
+		bool linear() const
+		{ return detail::isLinear(program, !std::is_floating_point<Value>::value); }
+	};
+
+	/// Solve prepared in the owning thread, which can run in any thread
+	/// @param solution Values indexed like variables at the time of preparing
+	/// @return false if no solution was found
+	using Job= std::function<bool (DynArray<Value>& solution)>;
+
+	/// State shared by the owning thread and the solving thread
+	struct AsyncTask {
+		Job job;
+		DynArray<Value> solution;
+		std::mutex mutex;
+		std::condition_variable finishedCond;
+		bool finished= false;
+		bool found= false;
+		/// Promises of `valueAsync` waiting for the solution
+		DynArray<std::pair<std::size_t, std::promise<Value>>> waiting;
+	};
+
+	/// Background solve. Touched only by the owning thread.
+	struct AsyncSolve {
+		/// Variables of the domain at the time of posting
 		DynArray<VarHandle> vars;
-		/// Quick and easy way to save posted relations for future reposting
-		AddRel post;
+		/// `Domain::layout` at the time of posting
+		std::size_t layout;
+		SharedPtr<AsyncTask> task;
 	};
 
-	DynArray<VarHandle> asHandles(const Set<BaseVar*>& container)
+	void post(Solver& solver)
+	{
+		for (std::size_t i= 0; i < vars.size(); ++i)
+			solver.addVar(i);
+		rels.post(solver);
+	}
+
+	/// Picks the backend by the structure of relations and solves
+	void solveNow()
+	{
+		if (solveEdited(std::integral_constant<bool, isSame<Solver, LinearSolver>()>{}))
+			return;
+		if (solveOrdering())
+			return;
+		if (solveMixedInteger(std::integral_constant<bool, isSame<Solver, ConstraintSolver>()>{}))
+			return;
+		if (Job job= searchJob(std::is_base_of<ConstraintSolver, Solver>{})) {
+			DynArray<Value> solution;
+			if (job(solution)) {
+				ensure(solution.size() == values.size());
+				std::copy(solution.begin(), solution.end(), values.begin());
+			}
+			backend= Backend::constraint;
+			dirty= false;
+			return;
+		}
+
+		if (!live) {
+			live.reset(new Solver{options});
+			postLive(std::integral_constant<bool, Solver::canRetract>{});
+		}
+		if (live->solve()) {
+			auto&& solution= live->getSolution();
+			ensure(solution.size() == values.size());
+			std::copy(solution.begin(), solution.end(), values.begin());
+		}
+
+		// Solvers which can't retract relations are rebuilt anyway
+		if (!Solver::canRetract)
+			live.reset();
+		backend= detail::BackendOf<Solver>::value;
+		dirty= false;
+	}
+
+	/// Writes the last solution of `solutions()`
+	void commitFinal(const Solver& solver)
+	{
+		auto&& solution= solver.getSolution();
+		ensure(solution.size() == values.size());
+		std::copy(solution.begin(), solution.end(), values.begin());
+		pending.reset();
+		backend= detail::BackendOf<Solver>::value;
+		dirty= false;
+		publish();
+	}
+
+	/// Copies values for readers of other threads, see `snapshot`
+	void publish()
+	{
+		auto snap= std::make_shared<Snapshot>();
+		snap->values= values;
+		snap->revision= revision;
+		snap->layout= layout;
+		std::atomic_store(&published, SharedPtr<const Snapshot>{std::move(snap)});
+	}
+
+	/// Posts to `live` remembering where relations with handles went
+	void postLive(std::true_type /*can retract*/)
+	{
+		for (std::size_t i= 0; i < vars.size(); ++i)
+			live->addVar(i);
+		liveRetracted= 0;
+
+		std::size_t begin= live->mark();
+		rels.post(*live, [this, &begin] (const detail::RelHeader& rec)
+		{
+			std::size_t end= live->mark();
+			if (rec.handle) {
+				rec.handle->liveBegin= begin;
+				rec.handle->liveEnd= end;
+			}
+			begin= end;
+		});
+	}
+
+	void postLive(std::false_type /*can retract*/)
+	{ post(*live); }
+
+	template <typename E>
+	void postLive(E rel, RelHandle& handle, std::true_type /*can retract*/)
+	{
+		handle.liveBegin= live->mark();
+		live->addRelation(rel);
+		handle.liveEnd= live->mark();
+		dirty= true;
+		++revision;
+	}
+
+	template <typename E>
+	void postLive(E, RelHandle&, std::false_type /*can retract*/)
+	{ invalidate(); }
+
+	/// Retracted positions stay in `live`, so it's rebuilt once they're
+	/// the majority
+	void retract(const RelHandle& handle, std::true_type /*can retract*/)
+	{
+		live->retract(handle.liveBegin, handle.liveEnd);
+		liveRetracted += handle.liveEnd - handle.liveBegin;
+		if (liveRetracted*2 > live->mark())
+			invalidate();
+	}
+
+	/// Edited variable and its suggested value
+	using Edit= std::pair<VarHandle, Value>;
+
+	typename DynArray<Edit>::iterator findEdit(const BaseVar& var)
 	{
-		DynArray<VarHandle> var_handles;
-		for (auto&& ptr : container) {
-			ensure(ptr);
-			var_handles.emplace_back(*ptr);
+		return std::find_if(edits.begin(), edits.end(),
+				[&var] (const Edit& e) { return &e.first.get() == &var; });
+	}
+
+	/// Solves with `editor` while some variable is edited
+	bool solveEdited(std::true_type /*linear*/)
+	{
+		if (edits.empty())
+			return false;
+
+		if (!editor)
+			buildEditor();
+		if (editor->solve()) {
+			auto&& solution= editor->getSolution();
+			ensure(solution.size() == values.size());
+			std::copy(solution.begin(), solution.end(), values.begin());
 		}
-		return var_handles;
+		backend= Backend::incremental;
+		dirty= false;
+		return true;
 	}
-	
+
+	bool solveEdited(std::false_type /*linear*/)
+	{ return false; }
+
+	/// Posts relations and edits to a new `editor`, which replaces `live`
+	/// Relations go through the model, because records post only to `Solver`
+	void buildEditor()
+	{
+		live.reset();
+		editor.reset(new IncrementalSolver);
+
+		detail::ModelWriter w{Model::typeOf<Value>()};
+		for (std::size_t i= 0; i < vars.size(); ++i) {
+			editor->addVar(i);
+			w.addVar(vars[i].get(), Solver::minValue(), Solver::maxValue());
+		}
+		DynArray<RelHandle*> handles;
+		rels.emit(w, [&handles] (const detail::RelHeader& rec)
+		{ handles.push_back(rec.handle); });
+
+		const Model& m= w.getModel();
+		ensure(handles.size() == m.rels.size());
+		for (std::size_t r= 0; r < m.rels.size(); ++r) {
+			std::size_t begin= editor->mark();
+			editor->addProgram(program(m, r),
+				[] (std::uint32_t i) -> std::size_t { return i; });
+			if (handles[r]) {
+				handles[r]->liveBegin= begin;
+				handles[r]->liveEnd= editor->mark();
+			}
+		}
+
+		for (auto&& e : edits) {
+			std::size_t i= e.first->getIndex();
+			editor->addEditVar(i);
+			editor->suggestValue(i, e.second);
+		}
+	}
+
+	/// Posts relation to `editor` or `mip`, which take programs
+	template <typename S2, typename E>
+	void postModel(S2& solver, E rel, RelHandle& handle)
+	{
+		detail::ModelWriter w{Model::typeOf<Value>()};
+		DynArray<std::size_t> indices;
+		for (auto&& v : rel.getVars()) {
+			w.addVar(*v, Solver::minValue(), Solver::maxValue());
+			indices.push_back(v->getIndex());
+		}
+		emitRel(w, rel, Model::hard);
+
+		handle.liveBegin= solver.mark();
+		solver.addProgram(program(w.getModel(), 0),
+			[&indices] (std::uint32_t i) { return indices[i]; });
+		handle.liveEnd= solver.mark();
+		dirty= true;
+		++revision;
+	}
+
+	void retract(const RelHandle&, std::false_type /*can retract*/)
+	{ }
+
+	/// Resolves domains of priority variables which are only ordered
+	/// by `<` and `>` without a solver
+	/// @return true if domain is such and has been solved
+	bool solveOrdering()
+	{
+		if (!isSame<Value, int>())
+			return false;
+
+		detail::Ordering o;
+		if (!rels.collectOrdering(o))
+			return false;
+
+		DynArray<int> solution;
+		if (!detail::resolve(o, vars.size(), solution))
+			return false;
+
+		std::copy(solution.begin(), solution.end(), values.begin());
+		backend= Backend::ordering;
+		dirty= false;
+		return true;
+	}
+
+	/// Solves integer domains of hard linear relations with branch and
+	/// bound over LP relaxations, see `Options::mixedInteger`
+	/// The integer LinearSolver is retained like `live`.
+	/// @return true if domain is such and has been solved
+	bool solveMixedInteger(std::true_type /*int domain*/)
+	{
+		if (!routesToMip())
+			return false;
+
+		if (!mip)
+			buildMip();
+		if (mip->solve())
+			roundMip(mip->getSolution(), values);
+		backend= Backend::mixedInteger;
+		dirty= false;
+		return true;
+	}
+
+	bool solveMixedInteger(std::false_type /*int domain*/)
+	{ return false; }
+
+	/// Mixed integer program of a background solve, see `solveMixedInteger`
+	/// @return empty if domain isn't solved as such
+	Job mixedIntegerJob(std::true_type /*int domain*/)
+	{
+		if (!routesToMip())
+			return Job{};
+
+		SharedPtr<LinearSolver> solver{makeMip(exportModel(),
+				[] (std::size_t, std::size_t, std::size_t) { })};
+		return [solver] (DynArray<Value>& solution)
+		{
+			if (!solver->solve())
+				return false;
+			solution.resize(solver->getSolution().size());
+			roundMip(solver->getSolution(), solution);
+			return true;
+		};
+	}
+
+	Job mixedIntegerJob(std::false_type /*int domain*/)
+	{ return Job{}; }
+
+	/// Decision is cached by revision, as checking every relation on every
+	/// solve would cost as much as posting them
+	bool routesToMip()
+	{
+		if (!options.mixedInteger || rels.empty())
+			return false;
+		if (mip)
+			return true;
+
+		if (linearRevision != revision) {
+			// Known mostly at compile time, so nonlinear domains aren't exported
+			linearRels= rels.linear();
+			linearRevision= revision;
+		}
+		return linearRels;
+	}
+
+	/// Integer LinearSolver posted with variables and relations of `m`
+	/// @param posted Called with index and range of marks of each relation
+	template <typename F>
+	static UniquePtr<LinearSolver> makeMip(const Model& m, F&& posted)
+	{
+		LinearSolver::Options o;
+		o.integer= true;
+		UniquePtr<LinearSolver> solver{new LinearSolver{o}};
+		for (std::size_t i= 0; i < m.vars.size(); ++i)
+			solver->addVar(i, m.vars[i].min.integer, m.vars[i].max.integer);
+		for (std::size_t r= 0; r < m.rels.size(); ++r) {
+			std::size_t begin= solver->mark();
+			solver->addProgram(program(m, r),
+				[] (std::uint32_t v) -> std::size_t { return v; });
+			posted(r, begin, solver->mark());
+		}
+		return solver;
+	}
+
+	/// Posts relations to a new `mip`, remembering where handles went
+	void buildMip()
+	{
+		detail::ModelWriter w{Model::typeOf<Value>()};
+		for (auto&& v : vars)
+			w.addVar(v.get(), Solver::minValue(), Solver::maxValue());
+		DynArray<RelHandle*> handles;
+		rels.emit(w, [&handles] (const detail::RelHeader& rec)
+		{ handles.push_back(rec.handle); });
+
+		mip= makeMip(w.getModel(),
+			[&handles] (std::size_t r, std::size_t begin, std::size_t end)
+			{
+				if (handles[r]) {
+					handles[r]->liveBegin= begin;
+					handles[r]->liveEnd= end;
+				}
+			});
+		liveRetracted= 0;
+	}
+
+	template <typename E>
+	void postMip(E rel, RelHandle& handle, std::true_type /*linear*/)
+	{ postModel(*mip, rel, handle); }
+
+	template <typename E>
+	void postMip(E, RelHandle&, std::false_type /*linear*/)
+	{ invalidate(); }
+
+	/// Like `retract` of `live`
+	void retractMip(const RelHandle& handle)
+	{
+		mip->retract(handle.liveBegin, handle.liveEnd);
+		liveRetracted += handle.liveEnd - handle.liveBegin;
+		if (liveRetracted*2 > mip->mark())
+			mip.reset();
+	}
+
+	static void roundMip(const DynArray<double>& solution, DynArray<Value>& rounded)
+	{
+		ensure(solution.size() == rounded.size());
+		for (std::size_t i= 0; i < solution.size(); ++i)
+			rounded[i]= static_cast<Value>(std::llround(solution[i]));
+	}
+
+	/// Search of `Options::portfolio` or `Options::threads`
+	/// @return empty if neither is enabled
+	Job searchJob(std::true_type /*constraint solver*/)
+	{
+		if (options.portfolio >= 2)
+			return portfolioJob();
+		if (	options.threads >= 2 && !vars.empty() &&
+				options.objective == Solver::Objective::weighted)
+			return parallelJob();
+		return Job{};
+	}
+
+	Job searchJob(std::false_type /*constraint solver*/)
+	{ return Job{}; }
+
+	/// Races solvers of different strategies, see `Options::portfolio`
+	/// A single strategy can be unlucky by orders of magnitude
+	Job portfolioJob()
+	{
+		// Posting refers to variables, so it's done in this thread
+		auto solvers= std::make_shared<DynArray<UniquePtr<Solver>>>();
+		for (std::size_t i= 0; i < options.portfolio; ++i) {
+			solvers->emplace_back(new Solver{Solver::portfolioMember(options, i)});
+			post(*solvers->back());
+		}
+
+		return [solvers] (DynArray<Value>& solution)
+		{
+			std::atomic<bool> done{false};
+			Solver* winner= nullptr;
+			bool found= false;
+			Executor::global().parallelFor(solvers->size(),
+				[&solvers, &done, &winner, &found] (std::size_t i)
+				{
+					auto&& member= *(*solvers)[i];
+					member.cancelWhen(done);
+					bool member_found= member.solve();
+					// Cancelled searches always see `done` set
+					if (!done.exchange(true)) {
+						winner= &member;
+						found= member_found;
+					}
+				});
+
+			ensure(winner);
+			if (found) {
+				auto&& s= winner->getSolution();
+				solution.assign(s.begin(), s.end());
+			}
+			return found;
+		};
+	}
+
+	/// Splits search tree of the domain between threads, see `Options::threads`
+	Job parallelJob()
+	{
+		auto solvers= std::make_shared<DynArray<UniquePtr<Solver>>>();
+		for (std::size_t i= 0; i < options.threads; ++i) {
+			solvers->emplace_back(new Solver{options});
+			post(*solvers->back());
+		}
+
+		return [solvers] (DynArray<Value>& solution)
+		{
+			// Many more subtrees than threads, because their difficulty varies
+			typename Solver::SharedSearch shared;
+			shared.subtrees= solvers->front()->split(solvers->size()*subtreesPerThread);
+
+			DynArray<char> found(solvers->size(), false);
+			DynArray<int64> best(solvers->size(), 0);
+			Executor::global().parallelFor(solvers->size(),
+				[&solvers, &shared, &found, &best] (std::size_t i)
+				{ found[i]= (*solvers)[i]->solveShared(shared, best[i]); });
+
+			for (std::size_t i= 0; i < solvers->size(); ++i) {
+				if (!found[i] || best[i] != shared.best.load())
+					continue;
+
+				auto&& s= (*solvers)[i]->getSolution();
+				solution.assign(s.begin(), s.end());
+				return true;
+			}
+			return false;
+		};
+	}
+
+	/// Fresh `Solver` of a background solve
+	Job solverJob()
+	{
+		SharedPtr<Solver> solver{new Solver{options}};
+		post(*solver);
+		return [solver] (DynArray<Value>& solution)
+		{
+			if (!solver->solve())
+				return false;
+			auto&& s= solver->getSolution();
+			solution.assign(s.begin(), s.end());
+			return true;
+		};
+	}
+
+	static constexpr std::size_t subtreesPerThread= 16;
+
+	/// Solution has to be rebuilt
+	void invalidate()
+	{
+		live.reset();
+		editor.reset();
+		mip.reset();
+		dirty= true;
+		++revision;
+	}
+
+	/// Writes finished background solution to variables which still exist
+	void commit()
+	{
+		ensure(pending);
+		auto&& task= *pending->task;
+		if (task.found) {
+			auto&& solution= task.solution;
+			ensure(solution.size() == pending->vars.size());
+			if (pending->layout == layout) {
+				// Variables added after posting are at the end
+				std::copy(solution.begin(), solution.end(), values.begin());
+			} else {
+				for (std::size_t i= 0; i < solution.size(); ++i) {
+					auto&& h= pending->vars[i];
+					if (h && &h->getDomain() == this)
+						values[h->getIndex()]= solution[i];
+				}
+			}
+		}
+		pending.reset();
+		publish();
+	}
+
+	static bool isFinished(AsyncTask& task)
+	{
+		std::lock_guard<std::mutex> lock(task.mutex);
+		return task.finished;
+	}
+
+	static void wait(AsyncTask& task)
+	{
+		std::unique_lock<std::mutex> lock(task.mutex);
+		task.finishedCond.wait(lock, [&task] () { return task.finished; });
+	}
+
+	/// Requires `task.mutex` to be locked
+	static void fulfill(AsyncTask& task, std::size_t index, std::promise<Value>& promise)
+	{
+		ensure(task.finished);
+		if (task.found) {
+			promise.set_value(task.solution[index]);
+		} else {
+			promise.set_exception(std::make_exception_ptr(
+						std::runtime_error{"No solution"}));
+		}
+	}
+
 	template <typename T>
 	void limitRange(T&) { }
 	template <typename T>
@@ -178,19 +1267,46 @@ private:
 		addRelation(var > 0 && var < maxPriorityCount());
 	}
 
-	DynArray<VarInfo> varInfos;
-	DynArray<RelInfo> relInfos;
+	DynArray<VarHandle> vars;
+	/// Values of `vars`
+	DynArray<Value> values;
+	/// Changed when indices of existing variables change
+	std::size_t layout= 0;
+	RelStorage<Solver> rels;
+	UniquePtr<AsyncSolve> pending;
+	/// Solver posted with current relations, if `Solver::canRetract`
+	UniquePtr<Solver> live;
+	/// Positions of `live` or `mip` freed by retracting
+	std::size_t liveRetracted= 0;
+	/// Variables of `beginEdit`
+	DynArray<Edit> edits;
+	/// Used instead of `live` while there are edits
+	UniquePtr<IncrementalSolver> editor;
+	/// Retained solver of `solveMixedInteger`
+	UniquePtr<LinearSolver> mip;
+	/// Whether relations are hard and linear, at `linearRevision`
+	bool linearRels= false;
+	std::size_t linearRevision= static_cast<std::size_t>(-1);
+	std::size_t revision= 0;
+	/// Revisions undone by `restore`, see `getState`
+	std::size_t undone= 0;
+	typename Solver::Options options;
+	Backend backend= Backend::none;
+	/// Read by other threads only through atomic operations
+	SharedPtr<const Snapshot> published;
 
 	/// Is solution up-to-date
 	bool dirty= false;
 };
 
-Set<BaseDomainPtr> domains(const Set<BaseVar*>& vars)
+/// Variables without a domain are skipped
+inline Set<BaseDomainPtr> domains(const Set<BaseVar*>& vars)
 {
 	Set<BaseDomainPtr> ds;
 	for (auto&& v : vars) {
 		ensure(v);
-		ds.insert(v->getDomainPtr());
+		if (auto d= v->getDomainPtr())
+			ds.insert(std::move(d));
 	}
 	return ds;
 }
@@ -198,6 +1314,107 @@ Set<BaseDomainPtr> domains(const Set<BaseVar*>& vars)
 template <typename E>
 using DomainOf= typename RemoveConst<RemoveRef<E>>::Domain;
 
+namespace detail {
+
+/// Held while a variable without a domain joins one
+inline std::mutex& joinMutex()
+{
+	static std::mutex mutex;
+	return mutex;
+}
+
+/// Locks domains of variables in address order, so that threads locking
+/// overlapping sets of domains can't deadlock
+/// Domain of a variable is changed only by merging, which holds the lock
+/// of the old domain, so locking is retried until the domains stay put.
+/// Variables without a domain join the first locked one, which is created
+/// if none of the variables has a domain.
+class DomainsLock {
+public:
+	explicit DomainsLock(const Set<BaseVar*>& vars)
+	{
+		while (!tryLock(vars))
+			unlock();
+	}
+
+	~DomainsLock() { unlock(); }
+
+	DomainsLock(const DomainsLock&)= delete;
+	DomainsLock& operator=(const DomainsLock&)= delete;
+
+private:
+	bool tryLock(const Set<BaseVar*>& vars)
+	{
+		locked= domains(vars);
+		if (locked.empty()) {
+			ensure(!vars.empty());
+			locked.insert((*vars.begin())->createDomain());
+		}
+		for (auto&& d : locked)
+			d->getMutex().lock();
+
+		DynArray<BaseVar*> free;
+		for (auto&& v : vars) {
+			BaseDomainPtr d= v->getDomainPtr();
+			if (!d)
+				free.push_back(v);
+			else if (locked.count(d) == 0)
+				return false;
+		}
+		if (free.empty())
+			return true;
+
+		// Joining is the only way for a variable to get a domain, so
+		// variables which are still free here stay so until joined
+		std::lock_guard<std::mutex> join_lock(joinMutex());
+		for (auto&& v : free) {
+			if (v->getDomainPtr())
+				return false;
+		}
+		for (auto&& v : free)
+			v->join(*locked.begin());
+		return true;
+	}
+
+	void unlock()
+	{
+		for (auto it= locked.rbegin(); it != locked.rend(); ++it)
+			(*it)->getMutex().unlock();
+		locked.clear();
+	}
+
+	/// Also keeps merged domains alive until unlocked
+	Set<BaseDomainPtr> locked;
+};
+
+/// @return Domain of `var`, created if `var` hasn't been related or read
+inline BaseDomainPtr domainOf(const BaseVar& var)
+{
+	BaseDomainPtr d= var.getDomainPtr();
+	if (!d) {
+		// Creating the domain changes only the pointer of the variable
+		DomainsLock lock{Set<BaseVar*>{const_cast<BaseVar*>(&var)}};
+		d= var.getDomainPtr();
+	}
+	return d;
+}
+
+/// Locks domain of a single variable
+/// Allocates only if the domain has to be created, see `domainOf`
+/// Safe from several threads only if built with EQ_ATOMIC_REFCOUNT, which
+/// synchronizes domain pointers of variables, see refptr.hpp
+inline std::unique_lock<std::mutex> lockDomainOf(const BaseVar& var)
+{
+	while (true) {
+		BaseDomainPtr d= domainOf(var);
+		std::unique_lock<std::mutex> lock(d->getMutex());
+		if (var.getDomainPtr() == d)
+			return lock;
+	}
+}
+
+} // detail
+
 } // eq
 
 #endif // EQ_DOMAIN_HPP
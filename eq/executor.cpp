@@ -0,0 +1,113 @@
+#include "executor.hpp"
+
+#include <atomic>
+#include <exception>
+
+namespace eq {
+
+Executor& Executor::global()
+{
+	static Executor executor{std::max(2u, std::thread::hardware_concurrency())};
+	return executor;
+}
+
+Executor::Executor(std::size_t thread_count)
+{
+	ensure(thread_count > 0);
+	for (std::size_t i= 0; i < thread_count; ++i)
+		threads.emplace_back([this] () { work(); });
+}
+
+Executor::~Executor()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit= true;
+	}
+	wakeUp.notify_all();
+
+	for (auto&& t : threads)
+		t.join();
+}
+
+void Executor::push(Task task)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		tasks.emplace_back(std::move(task));
+	}
+	wakeUp.notify_one();
+}
+
+void Executor::parallelFor(
+		std::size_t count,
+		const std::function<void (std::size_t)>& f)
+{
+	if (count == 0)
+		return;
+
+	// Shared, because helpers may start after the call has returned.
+	// `f` is touched only before that.
+	struct State {
+		const std::function<void (std::size_t)>* f;
+		std::size_t count;
+		std::atomic<std::size_t> next;
+		std::mutex mutex;
+		std::condition_variable doneCond;
+		std::size_t done;
+		std::exception_ptr error;
+	};
+	auto state= std::make_shared<State>();
+	state->f= &f;
+	state->count= count;
+	state->next= 0;
+	state->done= 0;
+
+	auto run= [state] ()
+	{
+		std::size_t i;
+		while ((i= state->next++) < state->count) {
+			std::exception_ptr error;
+			try {
+				(*state->f)(i);
+			} catch (...) {
+				error= std::current_exception();
+			}
+
+			std::lock_guard<std::mutex> lock(state->mutex);
+			if (error && !state->error)
+				state->error= error;
+			if (++state->done == state->count)
+				state->doneCond.notify_all();
+		}
+	};
+
+	std::size_t helper_count= std::min(threadCount(), count - 1);
+	for (std::size_t i= 0; i < helper_count; ++i)
+		push(run);
+	run();
+
+	std::unique_lock<std::mutex> lock(state->mutex);
+	state->doneCond.wait(lock, [&state] () { return state->done == state->count; });
+	if (state->error)
+		std::rethrow_exception(state->error);
+}
+
+void Executor::work()
+{
+	while (true) {
+		Task task;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wakeUp.wait(lock, [this] () { return quit || !tasks.empty(); });
+			if (tasks.empty())
+				return;
+
+			task= std::move(tasks.front());
+			tasks.pop_front();
+		}
+		task();
+	}
+}
+
+} // eq
@@ -0,0 +1,49 @@
+#ifndef EQ_EXECUTOR_HPP
+#define EQ_EXECUTOR_HPP
+
+#include "util.hpp"
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace eq {
+
+/// Runs tasks on a fixed set of background threads
+/// Tasks are started in the order they're pushed
+class Executor {
+public:
+	using Task= std::function<void ()>;
+
+	/// Executor used by domains for background solving
+	static Executor& global();
+
+	explicit Executor(std::size_t thread_count);
+	~Executor();
+
+	Executor(const Executor&)= delete;
+	Executor& operator=(const Executor&)= delete;
+
+	void push(Task task);
+
+	/// Calls `f(i)` for every i < count and returns when all calls are done
+	/// The calling thread takes part, so this can be called from a task.
+	/// Rethrows the first exception thrown by `f`.
+	void parallelFor(std::size_t count, const std::function<void (std::size_t)>& f);
+
+	std::size_t threadCount() const { return threads.size(); }
+
+private:
+	void work();
+
+	std::mutex mutex;
+	std::condition_variable wakeUp;
+	LinkedList<Task> tasks;
+	DynArray<std::thread> threads;
+	bool quit= false;
+};
+
+} // eq
+
+#endif // EQ_EXECUTOR_HPP
@@ -5,6 +5,9 @@
 #include "util.hpp"
 #include "varhandle.hpp"
 
+#include <cstdint>
+#include <iterator>
+
 namespace eq {
 namespace detail {
 
@@ -45,6 +48,8 @@ public:
 	T get() { return value; }
 
 	Set<BaseVar*> getVars() const { return value.getVars(); }
+	/// Same as checking `getVars()`, but doesn't allocate
+	bool refersTo(const BaseVar& var) const { return value.refersTo(var); }
 
 	explicit operator bool() const { return value.eval(); }
 
@@ -64,6 +69,7 @@ struct Expr<Var<T, type>> {
 
 	Var<T, type>& get() const { return static_cast<Var<T, type>&>(handle.get()); }
 	Set<BaseVar*> getVars() const { return {&handle.get()}; }
+	bool refersTo(const BaseVar& var) const { return &handle.get() == &var; }
 	T eval() const { return get(); }
 
 private:
@@ -81,6 +87,7 @@ struct Constant {
 	T get() { return value; }
 
 	Set<BaseVar*> getVars() const { return {}; }
+	bool refersTo(const BaseVar&) const { return false; }
 
 	T eval() const { return value; }
 
@@ -101,6 +108,9 @@ struct UOp {
 	Set<BaseVar*> getVars() const
 	{ return e.getVars(); }
 
+	bool refersTo(const BaseVar& var) const
+	{ return e.refersTo(var); }
+
 	auto eval() const
 	-> decltype(Op::eval(e.eval()))
 	{ return Op::eval(e.eval()); }
@@ -120,11 +130,60 @@ struct BiOp {
 	Set<BaseVar*> getVars() const
 	{ return lhs.getVars() + rhs.getVars(); }
 
+	bool refersTo(const BaseVar& var) const
+	{ return lhs.refersTo(var) || rhs.refersTo(var); }
+
 	auto eval() const
 	-> decltype(Op::eval(lhs.eval(), rhs.eval()))
 	{ return Op::eval(lhs.eval(), rhs.eval()); }
 };
 
+/// Sum of any number of terms of the same expression type, each multiplied
+/// by a constant coefficient, see `sum` and `dot`
+/// Unlike a chain of `+`, the type doesn't grow with the number of terms,
+/// and solvers post it as a single sum, scalar product or row.
+/// Terms are shared by copies, so passing the expression around is cheap.
+template <typename E, typename C>
+struct Sum {
+	using Domain= typename E::Domain;
+	using Value= decltype(std::declval<C>()*std::declval<const E&>().eval());
+
+	SharedPtr<const DynArray<E>> terms;
+	/// Coefficients of `terms`, or null if every coefficient is one
+	SharedPtr<const DynArray<C>> coeffs;
+
+	std::size_t size() const { return terms->size(); }
+	const E& term(std::size_t i) const { return (*terms)[i]; }
+	C coeff(std::size_t i) const { return coeffs ? (*coeffs)[i] : C{1}; }
+
+	Set<BaseVar*> getVars() const
+	{
+		Set<BaseVar*> vars;
+		for (auto&& t : *terms) {
+			auto&& v= t.getVars();
+			vars.insert(v.begin(), v.end());
+		}
+		return vars;
+	}
+
+	bool refersTo(const BaseVar& var) const
+	{
+		for (auto&& t : *terms) {
+			if (t.refersTo(var))
+				return true;
+		}
+		return false;
+	}
+
+	Value eval() const
+	{
+		Value value{};
+		for (std::size_t i= 0; i < size(); ++i)
+			value += coeff(i)*term(i).eval();
+		return value;
+	}
+};
+
 namespace detail {
 
 template <typename T>
@@ -201,6 +260,24 @@ struct ToExpr<int&> {
 	{ return Expr<Constant<int>>{t}; }
 };
 
+template <>
+struct ToExpr<std::int64_t> {
+	static Expr<Constant<std::int64_t>> eval(std::int64_t t)
+	{ return Expr<Constant<std::int64_t>>{t}; }
+};
+
+template <>
+struct ToExpr<const std::int64_t&> {
+	static Expr<Constant<std::int64_t>> eval(std::int64_t t)
+	{ return Expr<Constant<std::int64_t>>{t}; }
+};
+
+template <>
+struct ToExpr<std::int64_t&> {
+	static Expr<Constant<std::int64_t>> eval(std::int64_t t)
+	{ return Expr<Constant<std::int64_t>>{t}; }
+};
+
 template <>
 struct ToExpr<double> {
 	static Expr<Constant<double>> eval(double t)
@@ -480,6 +557,46 @@ auto operator!(E&& e)
 ->	Expr<UOp<decltype(expr(e)), Not>>
 { return UOp<decltype(expr(e)), Not>{expr(e)}; }
 
+namespace detail {
+
+/// Expression of an element of range R
+template <typename R>
+using TermOf= decltype(expr(*std::begin(std::declval<R&>())));
+
+template <typename E>
+using ValueOf= RemoveConst<RemoveRef<decltype(std::declval<const E&>().eval())>>;
+
+} // detail
+
+/// Sum of variables or expressions of a range
+///   e.g. `rel(eq::sum(widths) <= 100)`
+template <typename R>
+auto sum(R&& range)
+->	Expr<Sum<detail::TermOf<R>, detail::ValueOf<detail::TermOf<R>>>>
+{
+	using E= detail::TermOf<R>;
+	auto terms= std::make_shared<DynArray<E>>();
+	for (auto&& t : range)
+		terms->push_back(expr(t));
+	return Sum<E, detail::ValueOf<E>>{std::move(terms), nullptr};
+}
+
+/// Sum of elements of `range` multiplied by elements of `coeffs` pairwise
+///   e.g. `rel(eq::dot(prices, counts) <= budget)`
+template <typename CR, typename R>
+auto dot(const CR& coeffs, R&& range)
+->	Expr<Sum<detail::TermOf<R>, RemoveConst<RemoveRef<decltype(*std::begin(coeffs))>>>>
+{
+	using E= detail::TermOf<R>;
+	using C= RemoveConst<RemoveRef<decltype(*std::begin(coeffs))>>;
+	auto terms= std::make_shared<DynArray<E>>();
+	for (auto&& t : range)
+		terms->push_back(expr(t));
+	auto cs= std::make_shared<DynArray<C>>(std::begin(coeffs), std::end(coeffs));
+	ensure(cs->size() == terms->size() && "Coefficient count differs from term count");
+	return Sum<E, C>{std::move(terms), std::move(cs)};
+}
+
 
 
 namespace detail {
@@ -499,11 +616,82 @@ struct IsRelation<Expr<BiOp<E1, E2, Op>>> {
 	static constexpr bool value= isSame<Return<decltype(&BiOp<E1, E2, Op>::eval)>, bool>();
 };
 
+/// Polynomial degree of an expression, known at compile time
+/// Relations have the degree of their sides. Shapes which aren't
+/// polynomials, or systems of polynomials, are `nonlinearDegree`.
+constexpr int nonlinearDegree= 1000;
+
+constexpr int maxDegree(int a, int b) { return a > b ? a : b; }
+constexpr int sumDegree(int a, int b)
+{ return a + b > nonlinearDegree ? nonlinearDegree : a + b; }
+
+template <typename T>
+struct Degree {
+	static constexpr int value= nonlinearDegree;
+};
+
+template <typename T>
+struct Degree<Expr<T>> { static constexpr int value= Degree<T>::value; };
+
+template <typename T, VarType type>
+struct Degree<Var<T, type>> { static constexpr int value= 1; };
+
+template <typename T>
+struct Degree<Constant<T>> { static constexpr int value= 0; };
+
+template <typename E>
+struct Degree<UOp<E, Pos>> { static constexpr int value= Degree<E>::value; };
+
+template <typename E>
+struct Degree<UOp<E, Neg>> { static constexpr int value= Degree<E>::value; };
+
+/// Sides of sums and comparisons
+template <typename E1, typename E2>
+struct MaxDegree {
+	static constexpr int value= maxDegree(Degree<E1>::value, Degree<E2>::value);
+};
+
+template <typename E1, typename E2>
+struct Degree<BiOp<E1, E2, Add>> : MaxDegree<E1, E2> { };
+template <typename E1, typename E2>
+struct Degree<BiOp<E1, E2, Sub>> : MaxDegree<E1, E2> { };
+template <typename E1, typename E2>
+struct Degree<BiOp<E1, E2, Eq>> : MaxDegree<E1, E2> { };
+template <typename E1, typename E2>
+struct Degree<BiOp<E1, E2, Gr>> : MaxDegree<E1, E2> { };
+template <typename E1, typename E2>
+struct Degree<BiOp<E1, E2, Ls>> : MaxDegree<E1, E2> { };
+template <typename E1, typename E2>
+struct Degree<BiOp<E1, E2, Geq>> : MaxDegree<E1, E2> { };
+template <typename E1, typename E2>
+struct Degree<BiOp<E1, E2, Leq>> : MaxDegree<E1, E2> { };
+template <typename E1, typename E2>
+struct Degree<BiOp<E1, E2, And>> : MaxDegree<E1, E2> { };
+
+/// Coefficients are constants
+template <typename E, typename C>
+struct Degree<Sum<E, C>> { static constexpr int value= Degree<E>::value; };
+
+template <typename E1, typename E2>
+struct Degree<BiOp<E1, E2, Mul>> {
+	static constexpr int value= sumDegree(Degree<E1>::value, Degree<E2>::value);
+};
+
+// Division, `!=`, `||` and `!` stay nonlinear. Integer division truncates,
+// and the others aren't convex.
+
 } // detail
 
 template <typename T>
 constexpr bool isRelation() { return detail::IsRelation<T>::value; }
 
+template <typename T>
+constexpr int degree() { return detail::Degree<T>::value; }
+
+/// Can be posted as linear rows, see `LinearSolver`
+template <typename T>
+constexpr bool isLinear() { return degree<T>() <= 1; }
+
 
 } // eq
 
@@ -0,0 +1,650 @@
+#include "incrementalsolver.hpp"
+
+#include <cmath>
+
+namespace eq {
+namespace {
+
+/// Strength of relations, which never get error variables
+const double required= std::numeric_limits<double>::max();
+
+bool nearZero(double value)
+{ return std::abs(value) < 1e-8; }
+
+} // anonymous
+
+constexpr double IncrementalSolver::strong;
+
+void IncrementalSolver::addVar(std::size_t index)
+{
+	ensure(index == vars.size() && "Vars must be added in order");
+	Symbol s= makeSymbol(Symbol::Type::external);
+	s.var= index;
+	vars.push_back(s);
+	touchedAll= true;
+}
+
+void IncrementalSolver::retract(std::size_t begin, std::size_t end)
+{
+	for (std::size_t id= begin; id < end; ++id) {
+		failed.erase(id);
+		auto it= relations.find(id);
+		if (it == relations.end())
+			continue;
+		Tag tag= it->second;
+		relations.erase(it);
+		remove(tag, required);
+	}
+}
+
+void IncrementalSolver::addEditVar(std::size_t index)
+{
+	ensure(index < vars.size());
+	ensure(!hasEditVar(index) && "Var is already edited");
+
+	Form form;
+	form.terms.emplace_back(index, 1.0);
+	Edit edit{Tag{}, 0.0};
+	bool added= add(form, Relation::eq, strong, edit.tag);
+	ensure(added && "Soft relation can't fail");
+	edits[index]= edit;
+}
+
+void IncrementalSolver::removeEditVar(std::size_t index)
+{
+	auto it= edits.find(index);
+	ensure(it != edits.end() && "Var isn't edited");
+	Tag tag= it->second.tag;
+	edits.erase(it);
+	remove(tag, strong);
+}
+
+bool IncrementalSolver::hasEditVar(std::size_t index) const
+{ return edits.find(index) != edits.end(); }
+
+void IncrementalSolver::suggestValue(std::size_t index, double value)
+{
+	auto it= edits.find(index);
+	ensure(it != edits.end() && "Var isn't edited");
+	Edit& edit= it->second;
+	double delta= value - edit.value;
+	edit.value= value;
+
+	// Only the constant of the edit changes. If one of its error
+	// variables is basic, only that row is affected.
+	auto marker_row= rows.find(edit.tag.marker);
+	if (marker_row != rows.end()) {
+		marker_row->second.constant -= delta;
+		if (marker_row->second.constant < 0.0)
+			infeasible.push_back(marker_row->first);
+		dualOptimize();
+		return;
+	}
+
+	auto other_row= rows.find(edit.tag.other);
+	if (other_row != rows.end()) {
+		other_row->second.constant += delta;
+		if (other_row->second.constant < 0.0)
+			infeasible.push_back(other_row->first);
+		dualOptimize();
+		return;
+	}
+
+	auto column= columns.find(edit.tag.marker);
+	if (column != columns.end()) {
+		for (auto&& basic : column->second) {
+			Row& row= rows.at(basic);
+			row.constant += delta*row.coefficientFor(edit.tag.marker);
+			touch(basic);
+			if (row.constant < 0.0 && basic.type != Symbol::Type::external)
+				infeasible.push_back(basic);
+		}
+	}
+	dualOptimize();
+}
+
+bool IncrementalSolver::solve()
+{
+	if (!failed.empty())
+		return false;
+
+	auto read= [this] (Symbol s)
+	{
+		auto it= rows.find(s);
+		solution[s.var]= it != rows.end() ? it->second.constant : 0.0;
+	};
+
+	if (touchedAll) {
+		solution.resize(vars.size());
+		for (auto&& s : vars)
+			read(s);
+	} else {
+		for (auto&& s : touched)
+			read(s);
+	}
+	touched.clear();
+	touchedAll= false;
+	return true;
+}
+
+void IncrementalSolver::postInstr(const Model::Instr& instr, DynArray<Form>& stack)
+{
+	auto pop= [&stack] () -> Form
+	{
+		ensure(!stack.empty() && "Invalid program");
+		Form top= std::move(stack.back());
+		stack.pop_back();
+		return top;
+	};
+	auto scale= [] (Form& f, double factor)
+	{
+		for (auto&& t : f.terms)
+			t.second *= factor;
+		f.constant *= factor;
+	};
+	auto add= [] (Form& lhs, const Form& rhs)
+	{
+		lhs.terms.insert(lhs.terms.end(), rhs.terms.begin(), rhs.terms.end());
+		lhs.constant += rhs.constant;
+	};
+
+	using Op= Model::OpCode;
+	switch (instr.op) {
+		case Op::constant: {
+			Form f;
+			f.constant= instr.value.real;
+			stack.push_back(std::move(f));
+		} break;
+		case Op::add:
+		case Op::sub: {
+			Form rhs= pop();
+			Form lhs= pop();
+			if (instr.op == Op::sub)
+				scale(rhs, -1.0);
+			add(lhs, rhs);
+			stack.push_back(std::move(lhs));
+		} break;
+		case Op::mul: {
+			Form rhs= pop();
+			Form lhs= pop();
+			if (!lhs.terms.empty() && !rhs.terms.empty())
+				throw std::runtime_error{"IncrementalSolver: nonlinear multiplication"};
+			if (lhs.terms.empty())
+				std::swap(lhs, rhs);
+			scale(lhs, rhs.constant);
+			stack.push_back(std::move(lhs));
+		} break;
+		case Op::div: {
+			Form rhs= pop();
+			Form lhs= pop();
+			if (!rhs.terms.empty())
+				throw std::runtime_error{"IncrementalSolver: division by variable"};
+			scale(lhs, 1.0/rhs.constant);
+			stack.push_back(std::move(lhs));
+		} break;
+		case Op::pos:
+		break;
+		case Op::neg: {
+			Form e= pop();
+			scale(e, -1.0);
+			stack.push_back(std::move(e));
+		} break;
+		case Op::gr:
+		case Op::ls:
+			throw std::runtime_error{"IncrementalSolver: strict comparison"};
+		case Op::eq:
+		case Op::geq:
+		case Op::leq: {
+			// lhs - rhs compared to zero
+			Form rhs= pop();
+			Form diff= pop();
+			scale(rhs, -1.0);
+			add(diff, rhs);
+
+			Relation rel=	instr.op == Op::eq ? Relation::eq :
+							instr.op == Op::geq ? Relation::geq : Relation::leq;
+			std::size_t id= nextId++;
+			Tag tag;
+			if (this->add(diff, rel, required, tag))
+				relations[id]= tag;
+			else
+				failed.insert(id);
+
+			stack.push_back(Form{});
+		} break;
+		case Op::and_:
+			pop();
+			pop();
+			stack.push_back(Form{});
+		break;
+		default:
+			throw std::runtime_error{"IncrementalSolver: unsupported relation"};
+	}
+}
+
+double IncrementalSolver::Row::coefficientFor(Symbol s) const
+{
+	auto it= cells.find(s);
+	return it != cells.end() ? it->second : 0.0;
+}
+
+void IncrementalSolver::Row::insert(Symbol s, double coeff)
+{
+	double& c= cells[s];
+	c += coeff;
+	if (nearZero(c))
+		cells.erase(s);
+}
+
+void IncrementalSolver::Row::insert(const Row& other, double coeff)
+{
+	constant += other.constant*coeff;
+	for (auto&& cell : other.cells)
+		insert(cell.first, cell.second*coeff);
+}
+
+void IncrementalSolver::Row::remove(Symbol s)
+{ cells.erase(s); }
+
+void IncrementalSolver::Row::reverseSign()
+{
+	constant= -constant;
+	for (auto&& cell : cells)
+		cell.second= -cell.second;
+}
+
+void IncrementalSolver::Row::solveFor(Symbol s)
+{
+	auto it= cells.find(s);
+	ensure(it != cells.end());
+	double coeff= -1.0/it->second;
+	cells.erase(it);
+	constant *= coeff;
+	for (auto&& cell : cells)
+		cell.second *= coeff;
+}
+
+void IncrementalSolver::Row::solveFor(Symbol lhs, Symbol rhs)
+{
+	insert(lhs, -1.0);
+	solveFor(rhs);
+}
+
+void IncrementalSolver::Row::substitute(Symbol s, const Row& row)
+{
+	auto it= cells.find(s);
+	if (it == cells.end())
+		return;
+	double coeff= it->second;
+	cells.erase(it);
+	insert(row, coeff);
+}
+
+auto IncrementalSolver::makeSymbol(Symbol::Type type) -> Symbol
+{
+	Symbol s;
+	s.type= type;
+	s.id= nextSymbol++;
+	return s;
+}
+
+bool IncrementalSolver::add(const Form& form, Relation rel, double strength, Tag& tag)
+{
+	Row row= makeRow(form, rel, strength, tag);
+	Symbol subject= chooseSubject(row, tag);
+
+	bool all_dummies= true;
+	for (auto&& cell : row.cells)
+		all_dummies= all_dummies && cell.first.type == Symbol::Type::dummy;
+	if (!subject.valid() && all_dummies) {
+		// Combination of equalities, contradicting them unless constants match
+		if (!nearZero(row.constant))
+			return false;
+		subject= tag.marker;
+	}
+
+	bool added= true;
+	if (subject.valid()) {
+		row.solveFor(subject);
+		substitute(subject, row);
+		insertRow(subject, std::move(row));
+	} else {
+		added= addWithArtificial(row);
+	}
+	optimize(objective);
+	return added;
+}
+
+void IncrementalSolver::remove(const Tag& tag, double strength)
+{
+	if (tag.marker.type == Symbol::Type::error)
+		removeMarkerEffects(tag.marker, strength);
+	if (tag.other.type == Symbol::Type::error)
+		removeMarkerEffects(tag.other, strength);
+
+	auto it= rows.find(tag.marker);
+	if (it != rows.end()) {
+		takeRow(it);
+	} else {
+		// Marker of a redundant relation isn't in any row
+		bool found= false;
+		Symbol leaving= markerLeaving(tag.marker, found);
+		if (found) {
+			Row row= takeRow(rows.find(leaving));
+			row.solveFor(leaving, tag.marker);
+			substitute(tag.marker, row);
+		}
+	}
+	optimize(objective);
+}
+
+auto IncrementalSolver::makeRow(
+		const Form& form,
+		Relation rel,
+		double strength,
+		Tag& tag) -> Row
+{
+	Row row;
+	row.constant= form.constant;
+	for (auto&& t : form.terms) {
+		if (nearZero(t.second))
+			continue;
+		ensure(t.first < vars.size());
+		Symbol s= vars[t.first];
+		auto it= rows.find(s);
+		if (it != rows.end())
+			row.insert(it->second, t.second);
+		else
+			row.insert(s, t.second);
+	}
+
+	bool soft= strength < required;
+	if (rel == Relation::eq) {
+		if (soft) {
+			Symbol plus= makeSymbol(Symbol::Type::error);
+			Symbol minus= makeSymbol(Symbol::Type::error);
+			tag.marker= plus;
+			tag.other= minus;
+			row.insert(plus, -1.0);
+			row.insert(minus, 1.0);
+			objective.insert(plus, strength);
+			objective.insert(minus, strength);
+		} else {
+			Symbol dummy= makeSymbol(Symbol::Type::dummy);
+			tag.marker= dummy;
+			row.insert(dummy, 1.0);
+		}
+	} else {
+		// `form <= 0` is `form + slack = 0`
+		double coeff= rel == Relation::leq ? 1.0 : -1.0;
+		Symbol slack= makeSymbol(Symbol::Type::slack);
+		tag.marker= slack;
+		row.insert(slack, coeff);
+		if (soft) {
+			Symbol error= makeSymbol(Symbol::Type::error);
+			tag.other= error;
+			row.insert(error, -coeff);
+			objective.insert(error, strength);
+		}
+	}
+
+	if (row.constant < 0.0)
+		row.reverseSign();
+	return row;
+}
+
+auto IncrementalSolver::chooseSubject(const Row& row, const Tag& tag) const -> Symbol
+{
+	for (auto&& cell : row.cells) {
+		if (cell.first.type == Symbol::Type::external)
+			return cell.first;
+	}
+
+	auto restricted= [] (Symbol s)
+	{ return s.type == Symbol::Type::slack || s.type == Symbol::Type::error; };
+	if (restricted(tag.marker) && row.coefficientFor(tag.marker) < 0.0)
+		return tag.marker;
+	if (restricted(tag.other) && row.coefficientFor(tag.other) < 0.0)
+		return tag.other;
+	return Symbol{};
+}
+
+bool IncrementalSolver::addWithArtificial(const Row& row)
+{
+	// Minimizing the artificial variable finds a feasible point of the row
+	Symbol art= makeSymbol(Symbol::Type::slack);
+	insertRow(art, row);
+	artificial.reset(new Row(row));
+	optimize(*artificial);
+	bool success= nearZero(artificial->constant);
+	artificial.reset();
+
+	auto it= rows.find(art);
+	if (it != rows.end()) {
+		Row art_row= takeRow(it);
+		// Failed relation is dropped. Other rows haven't been pivoted
+		// with the artificial one, so they still hold without it.
+		if (!success)
+			return false;
+
+		Symbol entering;
+		for (auto&& cell : art_row.cells) {
+			if (	cell.first.type == Symbol::Type::slack ||
+					cell.first.type == Symbol::Type::error) {
+				entering= cell.first;
+				break;
+			}
+		}
+		// Otherwise the row is redundant
+		if (entering.valid()) {
+			art_row.solveFor(art, entering);
+			substitute(entering, art_row);
+			insertRow(entering, std::move(art_row));
+		}
+	}
+
+	auto column= columns.find(art);
+	if (column != columns.end()) {
+		for (auto&& basic : column->second)
+			rows.at(basic).remove(art);
+		columns.erase(column);
+	}
+	objective.remove(art);
+	return success;
+}
+
+void IncrementalSolver::insertRow(Symbol basic, Row row)
+{
+	for (auto&& cell : row.cells)
+		columns[cell.first].insert(basic);
+	touch(basic);
+	rows[basic]= std::move(row);
+}
+
+auto IncrementalSolver::takeRow(Map<Symbol, Row>::iterator it) -> Row
+{
+	ensure(it != rows.end());
+	Symbol basic= it->first;
+	Row row= std::move(it->second);
+	rows.erase(it);
+	for (auto&& cell : row.cells) {
+		auto column= columns.find(cell.first);
+		column->second.erase(basic);
+		if (column->second.empty())
+			columns.erase(column);
+	}
+	touch(basic);
+	return row;
+}
+
+void IncrementalSolver::substitute(Symbol s, const Row& row)
+{
+	auto column= columns.find(s);
+	if (column != columns.end()) {
+		// `s` disappears from every row
+		Set<Symbol> basics= std::move(column->second);
+		columns.erase(column);
+		for (auto&& basic : basics) {
+			Row& r= rows.at(basic);
+			r.substitute(s, row);
+			for (auto&& cell : row.cells) {
+				if (r.cells.count(cell.first)) {
+					columns[cell.first].insert(basic);
+				} else {
+					auto c= columns.find(cell.first);
+					if (c != columns.end()) {
+						c->second.erase(basic);
+						if (c->second.empty())
+							columns.erase(c);
+					}
+				}
+			}
+			touch(basic);
+			if (basic.type != Symbol::Type::external && r.constant < 0.0)
+				infeasible.push_back(basic);
+		}
+	}
+	objective.substitute(s, row);
+	if (artificial)
+		artificial->substitute(s, row);
+}
+
+void IncrementalSolver::pivot(Symbol leaving, Symbol entering)
+{
+	Row row= takeRow(rows.find(leaving));
+	row.solveFor(leaving, entering);
+	substitute(entering, row);
+	insertRow(entering, std::move(row));
+}
+
+void IncrementalSolver::optimize(Row& objective)
+{
+	while (true) {
+		Symbol entering;
+		for (auto&& cell : objective.cells) {
+			if (cell.first.type != Symbol::Type::dummy && cell.second < 0.0) {
+				entering= cell.first;
+				break;
+			}
+		}
+		if (!entering.valid())
+			return;
+
+		bool found= false;
+		Symbol leaving= leavingFor(entering, found);
+		ensure(found && "Objective is unbounded");
+		pivot(leaving, entering);
+	}
+}
+
+void IncrementalSolver::dualOptimize()
+{
+	while (!infeasible.empty()) {
+		Symbol leaving= infeasible.back();
+		infeasible.pop_back();
+
+		auto it= rows.find(leaving);
+		if (	it == rows.end() ||
+				nearZero(it->second.constant) ||
+				it->second.constant >= 0.0)
+			continue;
+
+		Symbol entering;
+		double ratio= std::numeric_limits<double>::max();
+		for (auto&& cell : it->second.cells) {
+			if (cell.second <= 0.0 || cell.first.type == Symbol::Type::dummy)
+				continue;
+			double r= objective.coefficientFor(cell.first)/cell.second;
+			if (r < ratio) {
+				ratio= r;
+				entering= cell.first;
+			}
+		}
+		ensure(entering.valid() && "Dual optimize failed");
+		pivot(leaving, entering);
+	}
+}
+
+auto IncrementalSolver::leavingFor(Symbol entering, bool& found) const -> Symbol
+{
+	Symbol leaving;
+	double ratio= std::numeric_limits<double>::max();
+	found= false;
+	auto column= columns.find(entering);
+	if (column == columns.end())
+		return leaving;
+
+	for (auto&& basic : column->second) {
+		if (basic.type == Symbol::Type::external)
+			continue;
+		const Row& row= rows.at(basic);
+		double coeff= row.coefficientFor(entering);
+		if (coeff >= 0.0)
+			continue;
+		double r= -row.constant/coeff;
+		if (r < ratio) {
+			ratio= r;
+			leaving= basic;
+			found= true;
+		}
+	}
+	return leaving;
+}
+
+auto IncrementalSolver::markerLeaving(Symbol marker, bool& found) const -> Symbol
+{
+	// Prefer restricted rows which stay feasible, then any restricted
+	// row, then unrestricted ones
+	double ratio_neg= std::numeric_limits<double>::max();
+	double ratio_pos= std::numeric_limits<double>::max();
+	Symbol first, second, third;
+	auto column= columns.find(marker);
+	if (column != columns.end()) {
+		for (auto&& basic : column->second) {
+			const Row& row= rows.at(basic);
+			double coeff= row.coefficientFor(marker);
+			if (basic.type == Symbol::Type::external) {
+				third= basic;
+			} else if (coeff < 0.0) {
+				double r= -row.constant/coeff;
+				if (r < ratio_neg) {
+					ratio_neg= r;
+					first= basic;
+				}
+			} else {
+				double r= row.constant/coeff;
+				if (r < ratio_pos) {
+					ratio_pos= r;
+					second= basic;
+				}
+			}
+		}
+	}
+
+	Symbol leaving= first.valid() ? first : second.valid() ? second : third;
+	found= leaving.valid();
+	return leaving;
+}
+
+void IncrementalSolver::touch(Symbol s)
+{
+	if (s.type != Symbol::Type::external || touchedAll)
+		return;
+	if (touched.size() >= vars.size()) {
+		touched.clear();
+		touchedAll= true;
+		return;
+	}
+	touched.push_back(s);
+}
+
+void IncrementalSolver::removeMarkerEffects(Symbol marker, double strength)
+{
+	auto it= rows.find(marker);
+	if (it != rows.end())
+		objective.insert(it->second, -strength);
+	else
+		objective.insert(marker, -strength);
+}
+
+} // eq
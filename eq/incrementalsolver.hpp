@@ -0,0 +1,195 @@
+#ifndef EQ_INCREMENTALSOLVER_HPP
+#define EQ_INCREMENTALSOLVER_HPP
+
+#include "model.hpp"
+#include "util.hpp"
+
+#include <limits>
+#include <stdexcept>
+
+namespace eq {
+
+/// Cassowary-style solver for interactive editing of linear relations
+/// Keeps an optimal simplex tableau between calls, so that adding and
+/// retracting relations pivot only locally, and a new value of an edit
+/// variable is reached by a few dual simplex pivots. Relations are
+/// required, edit variables are strong, so an edit variable gets the
+/// suggested value if relations allow it. Variables not determined by
+/// relations or edits are zero.
+/// Used by `Domain<LinearSolver>` while variables are edited, see
+/// `eq::beginEdit`.
+class IncrementalSolver {
+public:
+	using Value= double;
+	static constexpr bool hasPrioritySupport= false;
+	static constexpr bool canRetract= true;
+
+	static double minValue() { return -std::numeric_limits<double>::infinity(); }
+	static double maxValue() { return std::numeric_limits<double>::infinity(); }
+
+	/// @param index Index of the var in the domain, given in order
+	void addVar(std::size_t index);
+
+	/// Posts relation given as postfix program, see `Model`
+	/// Relation which contradicts the previous ones isn't posted, and
+	/// makes `solve` fail until it's retracted.
+	/// @param var_index Maps variable index of the program to index of the domain
+	template <typename F>
+	void addProgram(Program program, F&& var_index)
+	{
+		if (!program.hard())
+			throw std::runtime_error{"IncrementalSolver has no priority support"};
+
+		DynArray<Form> stack;
+		for (auto it= program.begin; it != program.end; ++it) {
+			if (it->op == Model::OpCode::var) {
+				Form form;
+				form.terms.emplace_back(var_index(it->index), 1.0);
+				stack.push_back(std::move(form));
+			} else {
+				postInstr(*it, stack);
+			}
+		}
+		ensure(stack.size() == 1 && "Invalid program");
+	}
+
+	/// Position of the next relation, see `retract`
+	std::size_t mark() const { return nextId; }
+
+	/// Removes relations posted between marks `begin` and `end`
+	void retract(std::size_t begin, std::size_t end);
+
+	/// Makes var at `index` follow `suggestValue`, initially zero
+	void addEditVar(std::size_t index);
+	void removeEditVar(std::size_t index);
+	bool hasEditVar(std::size_t index) const;
+
+	/// Moves the solution so that the edit var is as close to `value`
+	/// as relations allow
+	void suggestValue(std::size_t index, double value);
+
+	/// Reads values from the tableau, which is kept optimal
+	/// @return false if some posted relation couldn't be satisfied
+	bool solve();
+
+	/// Values of the solution, indexed like vars
+	const DynArray<double>& getSolution() const { return solution; }
+
+private:
+	/// Sum of variables multiplied by coefficients, and a constant
+	struct Form {
+		DynArray<std::pair<std::size_t, double>> terms;
+		double constant= 0.0;
+	};
+
+	/// Applies non-variable instruction of a program to the stack
+	/// Relations are posted and replaced by an empty form
+	void postInstr(const Model::Instr& instr, DynArray<Form>& stack);
+
+	struct Symbol {
+		enum class Type {
+			invalid,
+			/// Variable of the domain
+			external,
+			/// Nonnegative variable of an inequality
+			slack,
+			/// Nonnegative error of an edit
+			error,
+			/// Marker of an equality, never enters the basis
+			dummy
+		};
+
+		Type type= Type::invalid;
+		std::size_t id= 0;
+		/// Index of the var of an external symbol
+		std::size_t var= 0;
+
+		bool valid() const { return type != Type::invalid; }
+		bool operator<(const Symbol& other) const { return id < other.id; }
+		bool operator==(const Symbol& other) const { return id == other.id; }
+	};
+
+	/// `constant + sum(coeff*symbol)`, value of its basic symbol
+	struct Row {
+		Map<Symbol, double> cells;
+		double constant= 0.0;
+
+		double coefficientFor(Symbol s) const;
+		void insert(Symbol s, double coeff);
+		void insert(const Row& other, double coeff);
+		void remove(Symbol s);
+		void reverseSign();
+		/// Solves `0 = row` for `s`, which is removed
+		void solveFor(Symbol s);
+		/// Solves `lhs = row` for `rhs`
+		void solveFor(Symbol lhs, Symbol rhs);
+		/// Replaces `s` by `row`
+		void substitute(Symbol s, const Row& row);
+	};
+
+	/// Symbols added by a relation, used to remove it
+	struct Tag {
+		Symbol marker;
+		Symbol other;
+	};
+
+	enum class Relation { eq, geq, leq };
+
+	struct Edit {
+		Tag tag;
+		double value;
+	};
+
+	/// Strength of edits in the objective
+	static constexpr double strong= 1e6;
+
+	Symbol makeSymbol(Symbol::Type type);
+	/// @return false if the relation contradicts posted ones
+	bool add(const Form& form, Relation rel, double strength, Tag& tag);
+	void remove(const Tag& tag, double strength);
+	Row makeRow(const Form& form, Relation rel, double strength, Tag& tag);
+	Symbol chooseSubject(const Row& row, const Tag& tag) const;
+	bool addWithArtificial(const Row& row);
+	/// Stores `row` as the row of `basic`
+	void insertRow(Symbol basic, Row row);
+	/// Removes row of `it` from the tableau
+	Row takeRow(Map<Symbol, Row>::iterator it);
+	/// Replaces `s` in every row and the objective
+	void substitute(Symbol s, const Row& row);
+	/// Makes `entering` basic in place of `leaving`
+	void pivot(Symbol leaving, Symbol entering);
+	/// Primal simplex, ends when `objective` can't decrease
+	void optimize(Row& objective);
+	/// Dual simplex, ends when rows of `infeasible` are feasible again
+	void dualOptimize();
+	Symbol leavingFor(Symbol entering, bool& found) const;
+	Symbol markerLeaving(Symbol marker, bool& found) const;
+	void removeMarkerEffects(Symbol marker, double strength);
+	/// Value of `s` may have changed, see `solve`
+	void touch(Symbol s);
+
+	DynArray<Symbol> vars;
+	/// Rows by their basic symbol
+	Map<Symbol, Row> rows;
+	/// Basic symbols of rows which contain a symbol, so that changes of
+	/// a symbol touch only the rows where it appears
+	Map<Symbol, Set<Symbol>> columns;
+	/// Relations by id, see `mark`
+	Map<std::size_t, Tag> relations;
+	Map<std::size_t, Edit> edits;
+	Row objective;
+	UniquePtr<Row> artificial;
+	DynArray<Symbol> infeasible;
+	DynArray<double> solution;
+	/// External symbols whose value may differ from `solution`
+	DynArray<Symbol> touched;
+	bool touchedAll= true;
+	std::size_t nextSymbol= 0;
+	std::size_t nextId= 0;
+	/// Ids of relations which couldn't be posted
+	Set<std::size_t> failed;
+};
+
+} // eq
+
+#endif // EQ_INCREMENTALSOLVER_HPP
@@ -1,25 +1,762 @@
 #include "linearsolver.hpp"
 
+#include <algorithm>
+#include <cmath>
+#include <queue>
+
 namespace eq {
+namespace {
+
+/// Relative tolerance of comparing values to bounds
+const double tolerance= 1e-9;
+
+bool within(double value, double min, double max)
+{
+	return	value >= min - tolerance*(1.0 + std::abs(min)) &&
+			value <= max + tolerance*(1.0 + std::abs(max));
+}
+
+/// Coefficient of a sparse row or column
+struct Entry {
+	std::size_t index;
+	double value;
+};
 
-void LinearSolver::addVar(double& ref)
+bool operator==(const Entry& a, const Entry& b)
+{
+	return	a.index == b.index &&
+			std::abs(a.value - b.value) <= tolerance*(1.0 + std::abs(b.value));
+}
+
+/// Appends coefficients of `row`, sorted by variable
+void appendTerms(const op::MPConstraint& row, DynArray<Entry>& terms)
+{
+	std::size_t begin= terms.size();
+	for (auto&& t : row.terms())
+		terms.push_back(Entry{static_cast<std::size_t>(t.first->index()), t.second});
+	std::sort(terms.begin() + begin, terms.end(),
+		[] (const Entry& a, const Entry& b) { return a.index < b.index; });
+}
+
+/// LU factors of a sparse square matrix, by Gaussian elimination which
+/// picks the shortest remaining row as pivot row to keep fill-in low.
+/// Pivot is the biggest entry of that row.
+class SparseLu {
+public:
+	/// @param rows Entries of each row, indexed by column
+	/// @param max_entries Limit of entries in factors
+	/// @return false if matrix is singular or factors grew over the limit
+	bool factorize(DynArray<DynArray<Entry>> rows, std::size_t max_entries)
+	{
+		std::size_t n= rows.size();
+		steps.clear();
+		upper.clear();
+		lower.clear();
+
+		// Rows which may contain each column, including stale ones
+		DynArray<DynArray<std::size_t>> col_rows(n);
+		std::size_t entries= 0;
+		using Length= std::pair<std::size_t, std::size_t>;
+		std::priority_queue<Length, DynArray<Length>, std::greater<Length>> shortest;
+		for (std::size_t r= 0; r < n; ++r) {
+			for (auto&& e : rows[r])
+				col_rows[e.index].push_back(r);
+			entries += rows[r].size();
+			shortest.push(Length{rows[r].size(), r});
+		}
+
+		DynArray<char> done(n, false);
+		DynArray<double> work(n, 0.0);
+		DynArray<char> in_row(n, false);
+		while (steps.size() < n) {
+			ensure(!shortest.empty());
+			std::size_t pr= shortest.top().second;
+			bool stale= done[pr] || shortest.top().first != rows[pr].size();
+			shortest.pop();
+			if (stale)
+				continue;
+
+			auto&& pivot_row= rows[pr];
+			if (pivot_row.empty())
+				return false;
+			std::size_t pivot= 0;
+			for (std::size_t i= 1; i < pivot_row.size(); ++i) {
+				if (std::abs(pivot_row[i].value) > std::abs(pivot_row[pivot].value))
+					pivot= i;
+			}
+			if (std::abs(pivot_row[pivot].value) < tolerance)
+				return false;
+
+			Step step{pr, pivot_row[pivot].index, pivot_row[pivot].value, upper.size(), 0};
+			for (std::size_t i= 0; i < pivot_row.size(); ++i) {
+				if (i != pivot)
+					upper.push_back(pivot_row[i]);
+			}
+			step.end= upper.size();
+			steps.push_back(step);
+			done[pr]= true;
+
+			// Eliminates pivot column from other rows
+			for (std::size_t r : col_rows[step.col]) {
+				if (done[r])
+					continue;
+				auto&& row= rows[r];
+				auto it= std::find_if(row.begin(), row.end(),
+					[&step] (const Entry& e) { return e.index == step.col; });
+				if (it == row.end())
+					continue;
+
+				double factor= it->value/step.pivot;
+				row.erase(it);
+				lower.push_back(Elimination{r, pr, factor});
+				for (auto&& e : row) {
+					work[e.index]= e.value;
+					in_row[e.index]= true;
+				}
+				for (std::size_t i= step.begin; i < step.end; ++i) {
+					auto&& e= upper[i];
+					if (!in_row[e.index]) {
+						in_row[e.index]= true;
+						row.push_back(Entry{e.index, 0.0});
+						col_rows[e.index].push_back(r);
+						++entries;
+					}
+					work[e.index] -= factor*e.value;
+				}
+				for (auto&& e : row) {
+					e.value= work[e.index];
+					work[e.index]= 0.0;
+					in_row[e.index]= false;
+				}
+				shortest.push(Length{row.size(), r});
+			}
+
+			if (entries + lower.size() > max_entries)
+				return false;
+		}
+		return true;
+	}
+
+	/// Solves `A x = b`
+	/// @param b Indexed by row
+	/// @return `x`, indexed by column
+	DynArray<double> solve(DynArray<double> b) const
+	{
+		for (auto&& e : lower)
+			b[e.target] -= e.factor*b[e.source];
+
+		DynArray<double> x(b.size(), 0.0);
+		for (auto it= steps.rbegin(); it != steps.rend(); ++it) {
+			double sum= b[it->row];
+			for (std::size_t i= it->begin; i < it->end; ++i)
+				sum -= upper[i].value*x[upper[i].index];
+			x[it->col]= sum/it->pivot;
+		}
+		return x;
+	}
+
+private:
+	/// Pivot row of U, entries of which are `upper[begin, end)`
+	struct Step {
+		std::size_t row;
+		std::size_t col;
+		double pivot;
+		std::size_t begin;
+		std::size_t end;
+	};
+
+	/// Row operation of L: row `target` -= `factor` * row `source`
+	struct Elimination {
+		std::size_t target;
+		std::size_t source;
+		double factor;
+	};
+
+	DynArray<Step> steps;
+	DynArray<Entry> upper;
+	DynArray<Elimination> lower;
+};
+
+} // anonymous
+
+/// Problem in bounded form `A x - r = 0`, where both variables `x` and
+/// row activities `r` have bounds. Columns are variables followed by rows.
+/// Moving bounds of rows doesn't change the basis, only the values of
+/// basic columns. Basic rows follow from variables, so only the kernel of
+/// rows at their bounds and basic variables is factorized.
+struct LinearSolver::Basis {
+	static constexpr std::size_t none= static_cast<std::size_t>(-1);
+	using Status= op::MPSolver::BasisStatus;
+
+	std::size_t varCount;
+	/// Rows which had bounds when solved
+	std::size_t rowCount;
+	/// Coefficients of row `q` are `coeffs[rowStart[q], rowStart[q + 1])`,
+	/// sorted by variable
+	DynArray<std::size_t> rowStart;
+	DynArray<Entry> coeffs;
+	/// Row of the solver which each row currently is, or `none`
+	DynArray<std::size_t> solverRows;
+	/// Rows of the solver when the basis was last updated
+	std::size_t solverRowCount;
+
+	/// By column
+	DynArray<double> lower;
+	DynArray<double> upper;
+	DynArray<double> values;
+	DynArray<Status> status;
+	/// Position of basic variables and nonbasic rows in the kernel, or `none`
+	DynArray<std::size_t> position;
+
+	/// Columns of the kernel
+	DynArray<std::size_t> basicVars;
+	/// Rows of the kernel, which are at their bounds
+	DynArray<std::size_t> boundRows;
+	SparseLu kernel;
+
+	const Entry* rowBegin(std::size_t q) const { return coeffs.data() + rowStart[q]; }
+	const Entry* rowEnd(std::size_t q) const { return coeffs.data() + rowStart[q + 1]; }
+
+	bool isBasic(std::size_t col) const { return status[col] == Status::BASIC; }
+
+	/// @return false if statuses don't form a basis, or it is singular
+	bool factorize()
+	{
+		std::size_t n= varCount, m= rowCount;
+		position.assign(n + m, none);
+		for (std::size_t col= 0; col < n + m; ++col) {
+			auto&& picked= col < n ? basicVars : boundRows;
+			if (isBasic(col) == (col < n)) {
+				position[col]= picked.size();
+				picked.push_back(col);
+			}
+		}
+		if (basicVars.size() != boundRows.size())
+			return false;
+
+		std::size_t entries= 0;
+		DynArray<DynArray<Entry>> rows(boundRows.size());
+		for (std::size_t i= 0; i < boundRows.size(); ++i) {
+			std::size_t q= boundRows[i] - n;
+			for (auto e= rowBegin(q); e != rowEnd(q); ++e) {
+				if (isBasic(e->index))
+					rows[i].push_back(Entry{position[e->index], e->value});
+			}
+			entries += rows[i].size();
+		}
+		return kernel.factorize(std::move(rows), entries*maxFillIn + boundRows.size());
+	}
+
+	/// Changes of basic variables, indexed like `basicVars`, when bounds of
+	/// `boundRows` move by `shift`
+	DynArray<double> moveVars(DynArray<double> shift) const
+	{ return kernel.solve(std::move(shift)); }
+
+	/// Change of activity of row `q` when basic variables change by `delta`
+	double moveRow(std::size_t q, const DynArray<double>& delta) const
+	{
+		double sum= 0.0;
+		for (auto e= rowBegin(q); e != rowEnd(q); ++e) {
+			if (isBasic(e->index))
+				sum += e->value*delta[position[e->index]];
+		}
+		return sum;
+	}
+
+	/// Bound which nonbasic row `q` is at
+	/// @return NaN if the bound is no longer there
+	double boundOf(std::size_t q, double row_lower, double row_upper) const
+	{
+		double infinity= maxValue();
+		switch (status[varCount + q]) {
+			case Status::AT_LOWER_BOUND:
+			case Status::FIXED_VALUE:
+				return row_lower > -infinity ? row_lower : NAN;
+			case Status::AT_UPPER_BOUND:
+				return row_upper < infinity ? row_upper : NAN;
+			default:
+				return values[varCount + q];
+		}
+	}
+};
+
+constexpr std::size_t LinearSolver::Basis::none;
+
+LinearSolver::LinearSolver()= default;
+
+LinearSolver::LinearSolver(Options options)
+	: options(options)
+{ }
+
+LinearSolver::~LinearSolver()= default;
+
+void LinearSolver::addVar(std::size_t index)
 {
 	auto infinity= solver.infinity();
-	vars.add(ref, *solver.MakeNumVar(-infinity, infinity, ""));
+	addVar(index, -infinity, infinity);
+}
+
+void LinearSolver::addVar(std::size_t index, double min, double max)
+{
+	if (options.integer)
+		vars.add(index, *solver.MakeIntVar(min, max, ""));
+	else
+		vars.add(index, *solver.MakeNumVar(min, max, ""));
+}
+
+void LinearSolver::retract(std::size_t begin, std::size_t end)
+{
+	ensure(begin <= end && end <= static_cast<std::size_t>(solver.NumConstraints()));
+	// Rows are freed instead of deleted, which MPSolver doesn't support
+	auto&& rows= solver.constraints();
+	double infinity= solver.infinity();
+	for (std::size_t i= begin; i < end; ++i)
+		rows[i]->SetBounds(-infinity, infinity);
 }
 
-void LinearSolver::apply()
+bool LinearSolver::solve()
 {
+	if (moveWithinRanges())
+		return true;
+
 	op::MPSolver::ResultStatus status= solver.Solve();
 
 	/// @todo Throw error
 	if (status != op::MPSolver::OPTIMAL)
 		std::cout << "Solving error\n";
 
-	for (auto&& v : vars) {
-		ensure(v.actual && v.model);
-		*v.actual= v.model->solution_value();
+	solution.clear();
+	for (auto&& v : vars)
+		solution.push_back(v->solution_value());
+
+	basis.reset();
+	solvedBounds.clear();
+	solvedStatus.clear();
+	if (status != op::MPSolver::OPTIMAL || options.integer)
+		return status == op::MPSolver::OPTIMAL;
+
+	// Branch and bound has no basis, so only LPs are ranged
+	for (auto&& v : vars)
+		solvedStatus.push_back(v->basis_status());
+	for (auto&& c : solver.constraints()) {
+		solvedStatus.push_back(c->basis_status());
+		solvedBounds.push_back(Range{c->lb(), c->ub()});
+	}
+	return true;
+}
+
+auto LinearSolver::rhsRange(std::size_t row) const -> Range
+{
+	ensure(row < static_cast<std::size_t>(solver.NumConstraints()));
+	captureBasis();
+	auto&& c= *solver.constraints()[row];
+	double infinity= maxValue();
+	double bound= c.lb() > -infinity ? c.lb() : c.ub();
+
+	std::size_t q= basisRow(row);
+	if (q == Basis::none)
+		return Range{bound, bound};
+
+	const Basis& b= *basis;
+	std::size_t n= b.varCount, m= b.rowCount;
+	std::size_t col= n + q;
+	double value= b.values[col];
+	if (b.isBasic(col)) {
+		// Row isn't binding, so the solution doesn't move
+		double min= c.ub() < infinity ? value : -infinity;
+		double max= c.lb() > -infinity ? value : infinity;
+		return Range{min, max};
+	}
+	bound= value;
+
+	// Basic columns move linearly as the bound moves
+	DynArray<double> unit(b.boundRows.size(), 0.0);
+	unit[b.position[col]]= 1.0;
+	DynArray<double> delta= b.moveVars(std::move(unit));
+
+	double min_delta= -infinity, max_delta= infinity;
+	auto limit= [&b, &min_delta, &max_delta] (std::size_t basic, double g)
+	{
+		if (std::abs(g) < tolerance)
+			return;
+		double v= b.values[basic];
+		double to_lower= (b.lower[basic] - v)/g;
+		double to_upper= (b.upper[basic] - v)/g;
+		if (g < 0.0)
+			std::swap(to_lower, to_upper);
+		min_delta= std::max(min_delta, to_lower);
+		max_delta= std::min(max_delta, to_upper);
+	};
+	for (std::size_t p= 0; p < b.basicVars.size(); ++p)
+		limit(b.basicVars[p], delta[p]);
+	for (std::size_t r= 0; r < m; ++r) {
+		if (b.isBasic(n + r))
+			limit(n + r, b.moveRow(r, delta));
+	}
+	return Range{bound + min_delta, bound + max_delta};
+}
+
+void LinearSolver::captureBasis() const
+{
+	// Captured at most once per solve, even if it fails
+	DynArray<Range> bounds= std::move(solvedBounds);
+	DynArray<op::MPSolver::BasisStatus> status= std::move(solvedStatus);
+	solvedBounds.clear();
+	solvedStatus.clear();
+	if (basis || bounds.empty())
+		return;
+
+	auto&& rows= solver.constraints();
+	double infinity= maxValue();
+	std::size_t n= solution.size();
+	ensure(status.size() == n + bounds.size());
+
+	// Rows without bounds were retracted, and constrained nothing
+	DynArray<std::size_t> bounded;
+	for (std::size_t i= 0; i < bounds.size(); ++i) {
+		if (bounds[i].min > -infinity || bounds[i].max < infinity)
+			bounded.push_back(i);
+		else if (status[n + i] != op::MPSolver::BASIC)
+			return;
+	}
+	std::size_t m= bounded.size();
+	if (m == 0)
+		return;
+
+	UniquePtr<Basis> b{new Basis};
+	b->varCount= n;
+	b->rowCount= m;
+	b->solverRows= bounded;
+	b->solverRowCount= bounds.size();
+	b->rowStart.push_back(0);
+	for (std::size_t r= 0; r < m; ++r) {
+		appendTerms(*rows[bounded[r]], b->coeffs);
+		b->rowStart.push_back(b->coeffs.size());
+	}
+
+	for (std::size_t j= 0; j < n; ++j) {
+		auto&& v= vars.get(j);
+		b->lower.push_back(v.lb());
+		b->upper.push_back(v.ub());
+		b->values.push_back(solution[j]);
+		b->status.push_back(status[j]);
+	}
+	for (std::size_t r= 0; r < m; ++r) {
+		double activity= 0.0;
+		for (auto e= b->rowBegin(r); e != b->rowEnd(r); ++e)
+			activity += e->value*solution[e->index];
+		b->lower.push_back(bounds[bounded[r]].min);
+		b->upper.push_back(bounds[bounded[r]].max);
+		b->values.push_back(activity);
+		b->status.push_back(status[n + bounded[r]]);
+	}
+
+	if (b->factorize())
+		basis= std::move(b);
+}
+
+bool LinearSolver::retractedSinceSolve() const
+{
+	auto&& rows= solver.constraints();
+	double infinity= maxValue();
+	for (std::size_t i= 0; i < solvedBounds.size(); ++i) {
+		bool was_bounded= solvedBounds[i].min > -infinity || solvedBounds[i].max < infinity;
+		bool bounded= rows[i]->lb() > -infinity || rows[i]->ub() < infinity;
+		if (was_bounded && !bounded)
+			return true;
+	}
+	return false;
+}
+
+bool LinearSolver::moveWithinRanges()
+{
+	// Basis is needed only to match rows replacing retracted ones
+	if (!basis && retractedSinceSolve())
+		captureBasis();
+	if (!basis || vars.size() != basis->varCount)
+		return false;
+
+	Basis& b= *basis;
+	auto&& rows= solver.constraints();
+	double infinity= solver.infinity();
+	std::size_t n= b.varCount, m= b.rowCount;
+
+	// Current bounds of the rows of the basis. Retracted rows are free.
+	DynArray<std::size_t> solver_rows= b.solverRows;
+	DynArray<double> lower(m, -infinity), upper(m, infinity);
+	for (std::size_t q= 0; q < m; ++q) {
+		if (solver_rows[q] == Basis::none)
+			continue;
+		auto&& row= *rows[solver_rows[q]];
+		if (row.lb() > -infinity || row.ub() < infinity) {
+			lower[q]= row.lb();
+			upper[q]= row.ub();
+		} else {
+			solver_rows[q]= Basis::none;
+		}
+	}
+
+	// Added rows have to take the place of retracted rows of the same
+	// coefficients, otherwise the problem has really changed
+	DynArray<Entry> terms;
+	for (std::size_t i= b.solverRowCount; i < rows.size(); ++i) {
+		auto&& row= *rows[i];
+		if (row.lb() <= -infinity && row.ub() >= infinity)
+			continue;
+
+		terms.clear();
+		appendTerms(row, terms);
+		std::size_t match= Basis::none;
+		for (std::size_t q= 0; q < m && match == Basis::none; ++q) {
+			if (	solver_rows[q] == Basis::none &&
+					terms.size() == static_cast<std::size_t>(b.rowEnd(q) - b.rowBegin(q)) &&
+					std::equal(terms.begin(), terms.end(), b.rowBegin(q)))
+				match= q;
+		}
+		if (match == Basis::none)
+			return false;
+
+		solver_rows[match]= i;
+		lower[match]= row.lb();
+		upper[match]= row.ub();
+	}
+
+	// Rows at their bounds follow them, which moves the basic columns
+	DynArray<double> values= b.values;
+	DynArray<double> shift(b.boundRows.size(), 0.0);
+	bool moved= false;
+	for (std::size_t k= 0; k < b.boundRows.size(); ++k) {
+		std::size_t q= b.boundRows[k] - n;
+		double target= b.boundOf(q, lower[q], upper[q]);
+		if (std::isnan(target))
+			return false;
+		shift[k]= target - values[n + q];
+		values[n + q]= target;
+		moved= moved || shift[k] != 0.0;
+	}
+
+	if (moved) {
+		DynArray<double> delta= b.moveVars(std::move(shift));
+		for (std::size_t p= 0; p < b.basicVars.size(); ++p)
+			values[b.basicVars[p]] += delta[p];
+		for (std::size_t q= 0; q < m; ++q) {
+			if (b.isBasic(n + q))
+				values[n + q] += b.moveRow(q, delta);
+		}
+	}
+
+	for (std::size_t j= 0; j < n; ++j) {
+		if (!within(values[j], b.lower[j], b.upper[j]))
+			return false;
+	}
+	for (std::size_t q= 0; q < m; ++q) {
+		if (!within(values[n + q], lower[q], upper[q]))
+			return false;
+	}
+
+	// Basis stays the same, so it's valid for further moves
+	b.values= std::move(values);
+	std::copy(lower.begin(), lower.end(), b.lower.begin() + n);
+	std::copy(upper.begin(), upper.end(), b.upper.begin() + n);
+	b.solverRows= std::move(solver_rows);
+	b.solverRowCount= rows.size();
+
+	solution.assign(b.values.begin(), b.values.begin() + n);
+	return true;
+}
+
+std::size_t LinearSolver::basisRow(std::size_t row) const
+{
+	if (!basis)
+		return Basis::none;
+	auto&& rows= basis->solverRows;
+	auto it= std::find(rows.begin(), rows.end(), row);
+	return it == rows.end() ? Basis::none : it - rows.begin();
+}
+
+void LinearSolver::postInstr(
+		const Model::Instr& instr,
+		DynArray<detail::LinearForm>& stack)
+{
+	using Form= detail::LinearForm;
+	auto pop= [&stack] () -> Form
+	{
+		ensure(!stack.empty() && "Invalid program");
+		Form top= std::move(stack.back());
+		stack.pop_back();
+		return top;
+	};
+	auto scale= [] (Form& f, double factor)
+	{
+		for (auto&& t : f.terms)
+			t.second *= factor;
+		f.constant *= factor;
+	};
+	auto add= [] (Form& lhs, const Form& rhs)
+	{
+		lhs.terms.insert(lhs.terms.end(), rhs.terms.begin(), rhs.terms.end());
+		lhs.constant += rhs.constant;
+	};
+
+	using Op= Model::OpCode;
+	switch (instr.op) {
+		case Op::constant: {
+			Form f;
+			f.constant= options.integer ?	instr.value.integer :
+											instr.value.real;
+			stack.push_back(std::move(f));
+		} break;
+		case Op::add:
+		case Op::sub: {
+			Form rhs= pop();
+			Form lhs= pop();
+			if (instr.op == Op::sub)
+				scale(rhs, -1.0);
+			add(lhs, rhs);
+			stack.push_back(std::move(lhs));
+		} break;
+		case Op::mul: {
+			Form rhs= pop();
+			Form lhs= pop();
+			if (!lhs.terms.empty() && !rhs.terms.empty())
+				throw std::runtime_error{"LinearSolver: nonlinear multiplication"};
+			if (lhs.terms.empty())
+				std::swap(lhs, rhs);
+			scale(lhs, rhs.constant);
+			stack.push_back(std::move(lhs));
+		} break;
+		case Op::div: {
+			Form rhs= pop();
+			Form lhs= pop();
+			if (!rhs.terms.empty())
+				throw std::runtime_error{"LinearSolver: division by variable"};
+			scale(lhs, 1.0/rhs.constant);
+			stack.push_back(std::move(lhs));
+		} break;
+		case Op::pos:
+		break;
+		case Op::neg: {
+			Form e= pop();
+			scale(e, -1.0);
+			stack.push_back(std::move(e));
+		} break;
+		case Op::gr:
+		case Op::ls:
+			if (!options.integer)
+				throw std::runtime_error{"LinearSolver: strict comparison"};
+		// fallthrough
+		case Op::eq:
+		case Op::geq:
+		case Op::leq: {
+			// lhs - rhs compared to zero
+			Form rhs= pop();
+			Form diff= pop();
+			scale(rhs, -1.0);
+			add(diff, rhs);
+			// Integer `a < b` is `a - b <= -1`
+			if (instr.op == Op::ls)
+				diff.constant += 1.0;
+			else if (instr.op == Op::gr)
+				diff.constant -= 1.0;
+
+			Map<op::MPVariable*, double> coeffs;
+			for (auto&& t : diff.terms)
+				coeffs[t.first] += t.second;
+
+			double infinity= solver.infinity();
+			double bound= -diff.constant;
+			auto c= solver.MakeRowConstraint(
+					instr.op == Op::leq || instr.op == Op::ls ? -infinity : bound,
+					instr.op == Op::geq || instr.op == Op::gr ? infinity : bound);
+			for (auto&& pair : coeffs)
+				c->SetCoefficient(pair.first, pair.second);
+
+			stack.push_back(Form{});
+		} break;
+		case Op::and_:
+			pop();
+			pop();
+			stack.push_back(Form{});
+		break;
+		default:
+			throw std::runtime_error{"LinearSolver: unsupported relation"};
+	}
+}
+
+namespace detail {
+
+bool isLinear(Program program, bool integer)
+{
+	if (!program.hard())
+		return false;
+
+	enum class Kind { constant, form, relation };
+	DynArray<Kind> stack;
+	auto pop= [&stack] () -> Kind
+	{
+		ensure(!stack.empty() && "Invalid program");
+		Kind top= stack.back();
+		stack.pop_back();
+		return top;
+	};
+
+	using Op= Model::OpCode;
+	for (auto it= program.begin; it != program.end; ++it) {
+		switch (it->op) {
+			case Op::var:
+				stack.push_back(Kind::form);
+			break;
+			case Op::constant:
+				stack.push_back(Kind::constant);
+			break;
+			case Op::add:
+			case Op::sub:
+			case Op::mul:
+			case Op::div: {
+				Kind rhs= pop(), lhs= pop();
+				if (lhs == Kind::relation || rhs == Kind::relation)
+					return false;
+				bool constant= lhs == Kind::constant && rhs == Kind::constant;
+				if (it->op == Op::mul && !constant &&
+						lhs != Kind::constant && rhs != Kind::constant)
+					return false;
+				// Integer division truncates
+				if (it->op == Op::div && (integer || rhs != Kind::constant))
+					return false;
+				stack.push_back(constant ? Kind::constant : Kind::form);
+			} break;
+			case Op::pos:
+			case Op::neg: {
+				Kind e= pop();
+				if (e == Kind::relation)
+					return false;
+				stack.push_back(e);
+			} break;
+			case Op::gr:
+			case Op::ls:
+				if (!integer)
+					return false;
+			// fallthrough
+			case Op::eq:
+			case Op::geq:
+			case Op::leq: {
+				Kind rhs= pop(), lhs= pop();
+				if (lhs == Kind::relation || rhs == Kind::relation)
+					return false;
+				stack.push_back(Kind::relation);
+			} break;
+			case Op::and_: {
+				Kind rhs= pop(), lhs= pop();
+				if (lhs != Kind::relation || rhs != Kind::relation)
+					return false;
+				stack.push_back(Kind::relation);
+			} break;
+			default:
+				return false;
+		}
 	}
+	return stack.size() == 1 && stack.back() == Kind::relation;
 }
 
+} // detail
 } // eq
@@ -2,9 +2,11 @@
 #define EQ_LINEARSOLVER_HPP
 
 #include "expr.hpp"
+#include "model.hpp"
 #include "util.hpp"
 #include "varstorage.hpp"
 
+#include <limits>
 #include <stdexcept>
 
 #if defined(__DEPRECATED)
@@ -12,11 +14,13 @@
 #undef __DEPRECATED // Hack to silence gcc
 #endif
 
-// Enable underlying solver
+// Enable underlying solvers
 #define USE_CLP
+#define USE_CBC
 // or-tools
 #include <linear_solver/linear_solver.h>
 #undef USE_CLP
+#undef USE_CBC
 
 // Restore
 #if defined(EQ_DEPRECATED)
@@ -33,32 +37,110 @@ struct MakeLinRel {
 	static_assert(!sizeof(T), "Solving for particular expr not implemented");
 };
 
+/// Sum of variables multiplied by coefficients, and a constant
+struct LinearForm {
+	DynArray<std::pair<op::MPVariable*, double>> terms;
+	double constant= 0.0;
+};
+
+/// @return true if `program` is a hard relation which LinearSolver accepts
+/// @param integer Strict comparisons are accepted, division isn't
+bool isLinear(Program program, bool integer);
+
 } // detail
 
 /// Drawbacks using LinearSolver
 ///   - handles only linear equations
 ///   - no priority support
-///   - no integer support (yet)
+///   - integers only through programs, see `Options::integer`
 class LinearSolver {
 public:
+	using Value= double;
 	static constexpr bool hasPrioritySupport= false;
+	static constexpr bool canRetract= true;
+
+	struct Options {
+		/// Variables take only integer values, and constants of programs
+		/// are read as integers. Solved with branch and bound (CBC)
+		/// over LP relaxations.
+		bool integer= false;
+	};
 
-	LinearSolver()= default;
+	/// Bound of a row, i.e. the constant of a relation, see `rhsRange`
+	struct Range {
+		double min;
+		double max;
+	};
 
-	void addVar(double& ref);
+	LinearSolver();
+	explicit LinearSolver(Options options);
+	~LinearSolver();
+
+	static double minValue() { return -std::numeric_limits<double>::infinity(); }
+	static double maxValue() { return std::numeric_limits<double>::infinity(); }
+
+	/// @param index Index of the var in the domain
+	void addVar(std::size_t index);
+	void addVar(std::size_t index, double min, double max);
 
 	/// @todo Normalize relation before calling makeRel
 	template <typename T>
 	void addRelation(Expr<T> rel)
-	{ makeRel(rel); }
+	{
+		static_assert(isLinear<Expr<T>>(), "LinearSolver handles only linear relations");
+		makeRel(rel);
+	}
 
 	template <typename T>
 	void addRelation(Expr<T> rel, int priority)
 	{ static_assert(!sizeof(T), "LinearSolver has no priority support"); }
 
-	/// Solve and apply results
+	/// Posts relation given as postfix program, see `Model`
+	/// Unlike with expressions, any linear shape is accepted
+	/// @param var_index Maps variable index of the program to index of the domain
+	template <typename F>
+	void addProgram(Program program, F&& var_index)
+	{
+		if (!program.hard())
+			throw std::runtime_error{"LinearSolver has no priority support"};
+
+		DynArray<detail::LinearForm> stack;
+		for (auto it= program.begin; it != program.end; ++it) {
+			if (it->op == Model::OpCode::var) {
+				detail::LinearForm form;
+				form.terms.emplace_back(&vars.get(var_index(it->index)), 1.0);
+				stack.push_back(std::move(form));
+			} else {
+				postInstr(*it, stack);
+			}
+		}
+		ensure(stack.size() == 1 && "Invalid program");
+	}
+
+	/// Position of the next relation, see `retract`
+	std::size_t mark() const { return solver.NumConstraints(); }
+
+	/// Removes relations posted between marks `begin` and `end`
+	/// Solve can be called again afterwards.
+	void retract(std::size_t begin, std::size_t end);
+
+	/// If only constants of relations have changed since the last solve,
+	/// and they stay within `rhsRange`, the solution is moved analytically
+	/// instead of solving again. Relations are changed by retracting them
+	/// and adding ones of the same variables and coefficients.
 	/// @todo Make safe for sequential calls
-	void apply();
+	/// @return false if no optimal solution was found
+	bool solve();
+
+	/// Values of the solution, indexed like vars
+	const DynArray<double>& getSolution() const { return solution; }
+
+	/// Range of the bound of row at position `row` where the basis of the
+	/// last solution stays feasible. Within it the solution moves linearly
+	/// with the bound. The bound is the one which the row is at, if any.
+	/// Only the current bound if ranging isn't available, e.g. for integer
+	/// problems or if CLP reported no basis.
+	Range rhsRange(std::size_t row) const;
 
 private:
 	template <typename T>
@@ -70,8 +152,39 @@ private:
 	-> decltype(detail::MakeLinRel<RemoveRef<E>>::eval(*this, t, std::declval<Args>()...))
 	{ return detail::MakeLinRel<RemoveRef<E>>::eval(*this, t, args...); }
 
-	op::MPSolver solver{"solver", op::MPSolver::CLP_LINEAR_PROGRAMMING};
-	VarStorage<double, op::MPVariable> vars;
+	/// Applies non-variable instruction of a program to the stack
+	/// Relations are posted as rows and replaced by an empty form
+	void postInstr(const Model::Instr& instr, DynArray<detail::LinearForm>& stack);
+
+	/// Sparse copy of the solved problem and its factorized basis, see `rhsRange`
+	struct Basis;
+
+	/// Entries of the factors of a basis per entry of the basis matrix,
+	/// beyond which solving again is cheaper than moving solutions
+	static constexpr std::size_t maxFillIn= 8;
+
+	/// Factorizes the basis of the last solution, if not done yet
+	/// Done lazily, because most solutions are never moved
+	void captureBasis() const;
+	/// @return true if a row bounded in the last solve has been retracted
+	bool retractedSinceSolve() const;
+	/// @return true if solution has been moved to current bounds of rows
+	bool moveWithinRanges();
+	/// @return Position of `row` in the basis, or `Basis::none`
+	std::size_t basisRow(std::size_t row) const;
+
+	Options options;
+	op::MPSolver solver{"solver",
+		options.integer ?	op::MPSolver::CBC_MIXED_INTEGER_PROGRAMMING :
+							op::MPSolver::CLP_LINEAR_PROGRAMMING};
+	VarStorage<op::MPVariable> vars;
+	DynArray<double> solution;
+	/// Bounds of rows in the last solve, until the basis is captured
+	mutable DynArray<Range> solvedBounds;
+	/// Basis status reported by CLP of variables followed by rows in the
+	/// last solve, as the solver forgets it when the problem changes
+	mutable DynArray<op::MPSolver::BasisStatus> solvedStatus;
+	mutable UniquePtr<Basis> basis;
 };
 
 namespace detail {
@@ -94,8 +207,25 @@ struct MakeLinRel<Var<T, type>> {
 		op::MPConstraint* c,
 		double coeff= 1.0)
 	{
-		auto&& model= self.vars.getInfo(v.get()).model;
-		c->SetCoefficient(model, coeff);
+		// Accumulated, as a var may be in several terms
+		op::MPVariable* var= &self.vars.get(v.getIndex());
+		c->SetCoefficient(var, c->GetCoefficient(var) + coeff);
+	}
+};
+
+/// Terms go to the same row
+template <typename E, typename C>
+struct MakeLinRel<Sum<E, C>> {
+	static void eval(
+		LinearSolver& self,
+		Sum<E, C> e,
+		op::MPConstraint* c,
+		double coeff= 1.0)
+	{
+		for (std::size_t i= 0; i < e.size(); ++i) {
+			E term= e.term(i);
+			self.makeRel(term, c, coeff*e.coeff(i));
+		}
 	}
 };
 
@@ -1,7 +1,14 @@
+#include "batch.hpp"
+#include "batchsolve.hpp"
+#include "modelinstance.hpp"
+#include "rect.hpp"
 #include "rel.hpp"
+#include "scope.hpp"
 #include "var.hpp"
 
+#include <chrono>
 #include <iostream>
+#include <sstream>
 
 namespace gui {
 
@@ -61,17 +68,10 @@ public:
 	auto height() const -> decltype(top() - bottom()) { return top() - bottom(); }
 	auto width() const -> decltype(right() - left()) { return right() - left(); }
 
-	auto contains(const Box& other) const
-	-> decltype(right() <= right() && // Waiting for C++14...
-				top() <= top() &&
-				left() >= left() &&
-				bottom() >= bottom())
-	{
-		return	other.right() <= right() &&
-				other.top() <= top() &&
-				other.left() >= left() &&
-				other.bottom() >= bottom();
-	}
+	eq::Rect<int> rect() const { return {left(), bottom(), right(), top()}; }
+
+	eq::Expr<eq::Contains<int>> contains(const Box& other) const
+	{ return eq::contains(rect(), other.rect()); }
 
 	void add(Box& box)
 	{
@@ -195,4 +195,164 @@ int main()
 		rel(y == 1.0 && 2.0*x + 3.0*y == 5.51);
 		std::cout << "Linear: " << x << std::endl;
 	}
+
+	{
+		// Solving in background thread
+		eq::Var<int> x;
+		rel(x*3 == 12);
+
+		auto future= x.valueAsync();
+		std::cout << "Async: " << x.lastValue() << " -> " << future.get() << std::endl;
+	}
+
+	{
+		// Replaying exported model
+		eq::PriorityVar low, high;
+		rel(low < high);
+
+		eq::Var<int> x, y;
+		rel(x == 1, high);
+		rel(x == 2, low);
+		rel(y == x + 1);
+
+		std::stringstream file;
+		eq::writeModel(eq::exportModel(x), file);
+
+		eq::ModelInstance<int> replay{eq::readModel(file)};
+		std::cout << "Replayed: " << replay[0] << ", " << replay[1] << std::endl;
+	}
+
+	{
+		// Checking candidate values without solving
+		eq::Var<int> x, y;
+		eq::BatchEval<int> fits(x + 10 <= y, {&x, &y});
+
+		int xs[]= {0, 5, 10};
+		int ys[]= {20, 10, 15};
+		std::cout << "Fitting: " << fits.select({xs, ys}, 3).size() << std::endl;
+	}
+
+	{
+		// Solving a model for many parameter values
+		eq::Var<int> width, x;
+		rel(x*2 == width);
+
+		eq::Model m= eq::exportModel<int>({&width, &x});
+		auto solutions= eq::solveBatch<int>(m, {0}, {100, 200, 300});
+		std::cout << "Batch: ";
+		for (std::size_t i= 0; i < solutions.size(); ++i)
+			std::cout << solutions[i][1] << " ";
+		std::cout << std::endl;
+	}
+
+	{
+		// Removing single relation
+		eq::Var<double> x;
+		rel(x >= 1.0);
+		eq::RelHandle pinned= rel(x == 5.0);
+		std::cout << "Pinned: " << x;
+
+		pinned.remove();
+		std::cout << ", released: " << x << std::endl;
+	}
+
+	{
+		// Removing small relations stored before a large one
+		eq::Var<double> x, y;
+		std::vector<eq::RelHandle> bounds;
+		for (int i= 0; i < 16; ++i)
+			bounds.push_back(rel(x >= -1.0*i));
+
+		auto span= x + y;
+		auto span4= span + span + span + span;
+		auto span16= span4 + span4 + span4 + span4;
+		rel(span16 + span16 == 64.0 && x == 1.0);
+
+		// Compacts the relations, moving the large one past smaller blocks
+		for (auto& b : bounds)
+			b.remove();
+		std::cout << "Compacted: " << x << ", " << y << std::endl;
+	}
+
+	{
+		// Resizing within the range of the last solution, which is moved
+		// along the basis instead of solving again
+		eq::Var<double> left, width, right;
+		rel(left == 10.0 && left + width + -1.0*right == 0.0 && right <= 500.0);
+		eq::RelHandle size= rel(width == 100.0);
+		std::cout << "Resized: " << right;
+
+		size.remove();
+		size= rel(width == 200.0);
+		std::cout << " -> " << right << std::endl;
+	}
+
+	{
+		// Speculative query
+		eq::Var<int> width, x;
+		rel(x*2 == width && width >= 100);
+		std::cout << "What-if: " << x;
+		{
+			eq::Scope<int> what_if{width};
+			what_if.rel(width == 200);
+			std::cout << " -> " << x;
+		}
+		std::cout << " -> " << x << std::endl;
+	}
+
+	{
+		// Strict priorities
+		eq::PriorityVar low, high;
+		rel(low < high);
+
+		eq::Var<int> x;
+		rel(x == 1, high);
+		rel(x == 2, low);
+		rel(x*2 == 4, low);
+		rel(x + 1 == 3, low);
+		std::cout << "Weighted: " << x;
+
+		eq::ConstraintSolver::Options options;
+		options.objective= eq::ConstraintSolver::Objective::lexicographic;
+		eq::setSolverOptions(x, options);
+		std::cout << ", lexicographic: " << x << std::endl;
+	}
+
+	{
+		// Splitting search between threads
+		eq::PriorityVar low, high;
+		rel(low < high);
+
+		std::vector<eq::Var<int>> xs(12);
+		for (auto&& x : xs)
+			rel(x >= 0 && x <= 9);
+		rel(eq::sum(xs) == 50);
+		for (std::size_t i= 0; i + 1 < xs.size(); ++i) {
+			rel(xs[i] + xs[i + 1] == 9, low);
+			rel(xs[i]*xs[i + 1] == 18, high);
+		}
+
+		// Subtrees are split from ranges left by propagating relations
+		using Clock= std::chrono::steady_clock;
+		auto millis= [] (Clock::time_point start)
+		{
+			return std::chrono::duration_cast<std::chrono::milliseconds>(
+					Clock::now() - start).count();
+		};
+
+		eq::ConstraintSolver::Options options;
+		eq::setSolverOptions(xs[0], options);
+		auto start= Clock::now();
+		int serial= xs[0];
+		auto serial_ms= millis(start);
+
+		options.threads= 4;
+		eq::setSolverOptions(xs[0], options);
+		start= Clock::now();
+		int parallel= xs[0];
+		auto parallel_ms= millis(start);
+
+		std::cout	<< "Parallel: " << serial << " in " << serial_ms << " ms, "
+					<< parallel << " in " << parallel_ms << " ms" << std::endl;
+	}
 }
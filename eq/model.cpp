@@ -0,0 +1,329 @@
+#include "model.hpp"
+
+#include <cmath>
+#include <iomanip>
+#include <istream>
+#include <ostream>
+#include <sstream>
+#include <string>
+
+namespace eq {
+namespace {
+
+const char fileMagic[4]= {'E', 'Q', 'M', 'D'};
+const std::uint32_t fileByteOrder= 0x01020304;
+const std::uint32_t fileVersion= 1;
+
+template <typename T>
+void writeArray(std::ostream& out, const DynArray<T>& array)
+{
+	static_assert(std::is_trivially_copyable<T>::value, "Not writable as is");
+	out.write(reinterpret_cast<const char*>(array.data()), sizeof(T)*array.size());
+}
+
+template <typename T>
+void readArray(std::istream& in, DynArray<T>& array, std::size_t count)
+{
+	array.resize(count);
+	in.read(reinterpret_cast<char*>(array.data()), sizeof(T)*count);
+}
+
+/// Number of values `op` pops from the stack of a program
+std::size_t operandCount(Model::OpCode op)
+{
+	using Op= Model::OpCode;
+	switch (op) {
+		case Op::var:
+		case Op::constant:
+			return 0;
+		case Op::pos:
+		case Op::neg:
+		case Op::not_:
+			return 1;
+		default:
+			return 2;
+	}
+}
+
+/// Writes flattened constraints of a program, see `writeFlatZinc`
+class FlatZincWriter {
+public:
+	FlatZincWriter(const Model& m)
+		: model(m)
+		, real(m.type == Model::ValueType::real)
+		, prefix(real ? "float" : "int")
+	{ }
+
+	void write(std::ostream& out)
+	{
+		for (std::size_t i= 0; i < model.vars.size(); ++i) {
+			auto&& def= model.vars[i];
+			out << "var ";
+			if (real) {
+				double min= def.min.real, max= def.max.real;
+				if (std::isfinite(min) && std::isfinite(max))
+					out << literal(def.min) << ".." << literal(def.max);
+				else
+					out << "float";
+			} else {
+				out << literal(def.min) << ".." << literal(def.max);
+			}
+			out << ": x" << i << " :: output_var;\n";
+		}
+
+		for (std::size_t i= 0; i < model.rels.size(); ++i)
+			flatten(program(model, i));
+
+		if (successes.empty()) {
+			out << decls.str() << constraints.str();
+			out << "solve satisfy;\n";
+			return;
+		}
+
+		std::ostringstream coeffs, amounts;
+		for (auto&& s : successes) {
+			std::string amount= temp("var 0..1");
+			constraints << "constraint bool2int(" << s.first << ", " << amount << ");\n";
+			coeffs << s.second << ", ";
+			amounts << amount << ", ";
+		}
+		decls << "var int: success :: output_var;\n";
+		constraints	<< "constraint int_lin_eq([" << coeffs.str() << "-1], ["
+					<< amounts.str() << "success], 0);\n";
+
+		out << decls.str() << constraints.str();
+		out << "solve maximize success;\n";
+	}
+
+private:
+	std::string literal(Model::Number n) const
+	{
+		std::ostringstream ss;
+		if (real) {
+			ss << std::setprecision(17) << n.real;
+			// FlatZinc floats need a decimal point or an exponent
+			if (ss.str().find_first_of(".e") == std::string::npos)
+				ss << ".0";
+		} else {
+			ss << n.integer;
+		}
+		return ss.str();
+	}
+
+	std::string one(int sign) const
+	{ return real ? (sign > 0 ? "1.0" : "-1.0") : (sign > 0 ? "1" : "-1"); }
+
+	/// Declares a new introduced variable
+	std::string temp(const std::string& type)
+	{
+		std::string name= "t" + std::to_string(tempCount++);
+		decls << type << ": " << name << " :: var_is_introduced;\n";
+		return name;
+	}
+
+	void flatten(Program p)
+	{
+		DynArray<std::string> stack;
+		auto pop= [&stack] () -> std::string
+		{
+			ensure(!stack.empty());
+			std::string top= stack.back();
+			stack.pop_back();
+			return top;
+		};
+
+		for (auto it= p.begin; it != p.end; ++it) {
+			using Op= Model::OpCode;
+			switch (it->op) {
+				case Op::var:
+					stack.push_back("x" + std::to_string(it->index));
+				break;
+				case Op::constant:
+					stack.push_back(literal(it->value));
+				break;
+				case Op::add:
+				case Op::mul:
+				case Op::div: {
+					std::string rhs= pop(), lhs= pop();
+					std::string t= temp("var " + prefix);
+					const char* name=
+						it->op == Op::add ? "_plus(" :
+						it->op == Op::mul ? "_times(" : "_div(";
+					constraints	<< "constraint " << prefix << name
+								<< lhs << ", " << rhs << ", " << t << ");\n";
+					stack.push_back(t);
+				} break;
+				case Op::sub: {
+					std::string rhs= pop(), lhs= pop();
+					std::string t= temp("var " + prefix);
+					constraints	<< "constraint " << prefix << "_lin_eq(["
+								<< one(1) << ", " << one(-1) << ", " << one(-1) << "], ["
+								<< lhs << ", " << rhs << ", " << t << "], "
+								<< literal(Model::Number{}) << ");\n";
+					stack.push_back(t);
+				} break;
+				case Op::pos:
+				break;
+				case Op::neg: {
+					std::string e= pop();
+					std::string t= temp("var " + prefix);
+					constraints	<< "constraint " << prefix << "_lin_eq(["
+								<< one(1) << ", " << one(1) << "], ["
+								<< e << ", " << t << "], "
+								<< literal(Model::Number{}) << ");\n";
+					stack.push_back(t);
+				} break;
+				case Op::eq:
+				case Op::neq:
+				case Op::gr:
+				case Op::ls:
+				case Op::geq:
+				case Op::leq: {
+					std::string rhs= pop(), lhs= pop();
+					// Only `<`, `<=`, `==` and `!=` are available
+					if (it->op == Op::gr || it->op == Op::geq)
+						std::swap(lhs, rhs);
+					const char* name=
+						it->op == Op::eq ? "_eq" :
+						it->op == Op::neq ? "_ne" :
+						it->op == Op::gr || it->op == Op::ls ? "_lt" : "_le";
+					constraints	<< "constraint " << prefix << name;
+					if (p.hard()) {
+						constraints << "(" << lhs << ", " << rhs << ");\n";
+					} else {
+						std::string success= temp("var bool");
+						constraints	<< "_reif(" << lhs << ", " << rhs << ", "
+									<< success << ");\n";
+						successes.emplace_back(success, p.priority);
+					}
+					stack.push_back("");
+				} break;
+				case Op::and_:
+					pop();
+					pop();
+					stack.push_back("");
+				break;
+				default:
+					throw std::runtime_error{"FlatZinc export doesn't support || or !"};
+			}
+		}
+	}
+
+	const Model& model;
+	const bool real;
+	const std::string prefix;
+	std::ostringstream decls;
+	std::ostringstream constraints;
+	/// Reified soft relations and their priorities
+	DynArray<std::pair<std::string, std::int32_t>> successes;
+	std::size_t tempCount= 0;
+};
+
+} // anonymous
+
+void writeModel(const Model& m, std::ostream& out)
+{
+	detail::writeModelFile(m, nullptr, out);
+}
+
+Model readModel(std::istream& in)
+{
+	detail::FileHeader header;
+	in.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (!in)
+		throw std::runtime_error{"Not a model file"};
+	detail::checkHeader(header);
+
+	Model m;
+	m.type= header.type;
+	readArray(in, m.vars, header.varCount);
+	readArray(in, m.rels, header.relCount);
+	readArray(in, m.instrs, header.instrCount);
+	if (!in)
+		throw std::runtime_error{"Model file is truncated"};
+
+	detail::checkRefs(	m.type,
+						m.rels.data(), m.rels.size(),
+						m.instrs.data(), m.instrs.size(),
+						m.vars.size());
+	return m;
+}
+
+void writeFlatZinc(const Model& m, std::ostream& out)
+{
+	FlatZincWriter{m}.write(out);
+}
+
+namespace detail {
+
+void checkHeader(const FileHeader& h)
+{
+	if (!std::equal(fileMagic, fileMagic + 4, h.magic))
+		throw std::runtime_error{"Not a model file"};
+	if (h.byteOrder != fileByteOrder)
+		throw std::runtime_error{"Model file has different byte order"};
+	if (h.version != fileVersion)
+		throw std::runtime_error{"Unsupported model file version"};
+}
+
+void checkRefs(	Model::ValueType type,
+				const Model::RelDef* rels, std::size_t rel_count,
+				const Model::Instr* instrs, std::size_t instr_count,
+				std::size_t var_count)
+{
+	if (type != Model::ValueType::integer && type != Model::ValueType::real)
+		throw std::runtime_error{"Model file is corrupted"};
+
+	for (std::size_t i= 0; i < instr_count; ++i) {
+		if (instrs[i].op > Model::OpCode::not_)
+			throw std::runtime_error{"Model file is corrupted"};
+		if (instrs[i].op == Model::OpCode::var && instrs[i].index >= var_count)
+			throw std::runtime_error{"Model file is corrupted"};
+	}
+
+	for (std::size_t i= 0; i < rel_count; ++i) {
+		std::uint64_t begin= rels[i].begin;
+		if (begin + rels[i].size > instr_count)
+			throw std::runtime_error{"Model file is corrupted"};
+
+		// Solvers pop operands without checking, and take the only value
+		// left on the stack as the relation
+		std::size_t depth= 0;
+		for (std::uint64_t j= begin; j < begin + rels[i].size; ++j) {
+			std::size_t operands= operandCount(instrs[j].op);
+			if (depth < operands)
+				throw std::runtime_error{"Model file is corrupted"};
+			depth= depth - operands + 1;
+		}
+		if (depth != 1)
+			throw std::runtime_error{"Model file is corrupted"};
+	}
+}
+
+void writeModelFile(const Model& m, const Model::Number* solution, std::ostream& out)
+{
+	FileHeader header= {};
+	std::copy(fileMagic, fileMagic + 4, header.magic);
+	header.byteOrder= fileByteOrder;
+	header.version= fileVersion;
+	header.type= m.type;
+	header.varCount= m.vars.size();
+	header.relCount= m.rels.size();
+	header.instrCount= m.instrs.size();
+	header.flags= solution ? FileHeader::hasSolution : 0;
+
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	writeArray(out, m.vars);
+	writeArray(out, m.rels);
+	writeArray(out, m.instrs);
+	if (solution) {
+		out.write(	reinterpret_cast<const char*>(solution),
+					sizeof(*solution)*m.vars.size());
+	}
+
+	if (!out)
+		throw std::runtime_error{"Writing model failed"};
+}
+
+} // detail
+} // eq
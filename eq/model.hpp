@@ -0,0 +1,319 @@
+#ifndef EQ_MODEL_HPP
+#define EQ_MODEL_HPP
+
+#include "basevar.hpp"
+#include "expr.hpp"
+#include "util.hpp"
+
+#include <cstdint>
+#include <iosfwd>
+#include <stdexcept>
+
+namespace eq {
+
+/// Flat representation of a domain which doesn't refer to any C++ objects
+/// Relations are postfix programs which refer to variables by index
+///   e.g. `x*2 == y` -> [var 0, constant 2, mul, var 1, eq]
+/// All structs are trivially copyable so that they can be written
+/// to and read from files as they are
+struct Model {
+	enum class ValueType : std::uint8_t {
+		integer,
+		real
+	};
+
+	enum class OpCode : std::uint8_t {
+		var,
+		constant,
+		add,
+		sub,
+		mul,
+		div,
+		pos,
+		neg,
+		eq,
+		neq,
+		gr,
+		ls,
+		geq,
+		leq,
+		and_,
+		or_,
+		not_
+	};
+
+	/// Interpretation depends on `Model::type`
+	union Number {
+		std::int64_t integer;
+		double real;
+	};
+
+	struct VarDef {
+		Number min;
+		Number max;
+	};
+
+	struct RelDef {
+		/// Range in `instrs`
+		std::uint32_t begin;
+		std::uint32_t size;
+		/// Value of the PriorityVar, or `hard` for hard relations
+		std::int32_t priority;
+		std::uint32_t reserved;
+	};
+
+	struct Instr {
+		OpCode op;
+		std::uint8_t reserved[3];
+		/// Variable index for `OpCode::var`
+		std::uint32_t index;
+		/// Value for `OpCode::constant`
+		Number value;
+	};
+
+	static constexpr std::int32_t hard= 0;
+
+	template <typename T>
+	static constexpr ValueType typeOf()
+	{ return std::is_floating_point<T>::value ? ValueType::real : ValueType::integer; }
+
+	ValueType type= ValueType::integer;
+	DynArray<VarDef> vars;
+	DynArray<RelDef> rels;
+	DynArray<Instr> instrs;
+};
+
+/// Non-owning view to a relation of a model
+struct Program {
+	const Model::Instr* begin;
+	const Model::Instr* end;
+	std::int32_t priority;
+
+	bool hard() const { return priority == Model::hard; }
+};
+
+inline Program program(const Model& m, std::size_t rel)
+{
+	ensure(rel < m.rels.size());
+	auto&& def= m.rels[rel];
+	const Model::Instr* begin= m.instrs.data() + def.begin;
+	return Program{begin, begin + def.size, def.priority};
+}
+
+template <typename T>
+T numberAs(Model::Number n, Model::ValueType type)
+{
+	return type == Model::ValueType::real ?
+		static_cast<T>(n.real) : static_cast<T>(n.integer);
+}
+
+template <typename T>
+Model::Number toNumber(T value, Model::ValueType type)
+{
+	Model::Number n;
+	if (type == Model::ValueType::real)
+		n.real= static_cast<double>(value);
+	else
+		n.integer= static_cast<std::int64_t>(value);
+	return n;
+}
+
+/// Compact binary format
+/// Native byte order; reading a file of different byte order fails
+void writeModel(const Model& m, std::ostream& out);
+Model readModel(std::istream& in);
+
+/// FlatZinc for running the model with other solvers
+/// Soft relations are reified and their success maximized
+void writeFlatZinc(const Model& m, std::ostream& out);
+
+namespace detail {
+
+/// Layout of model files:
+///   FileHeader, VarDef[varCount], RelDef[relCount], Instr[instrCount],
+///   Number[varCount] if the file has a solution
+/// All sections are 8-byte aligned, so that files can be used through mmap
+struct FileHeader {
+	static constexpr std::uint32_t hasSolution= 1;
+
+	char magic[4];
+	std::uint32_t byteOrder;
+	std::uint32_t version;
+	Model::ValueType type;
+	std::uint8_t reserved[3];
+	std::uint32_t varCount;
+	std::uint32_t relCount;
+	std::uint32_t instrCount;
+	std::uint32_t flags;
+};
+
+/// Throws if `h` isn't a header of a readable model file
+void checkHeader(const FileHeader& h);
+
+/// Throws if programs refer outside of the model, use unknown types or
+/// opcodes, or don't leave exactly one value on the stack
+void checkRefs(	Model::ValueType type,
+				const Model::RelDef* rels, std::size_t rel_count,
+				const Model::Instr* instrs, std::size_t instr_count,
+				std::size_t var_count);
+
+/// @param solution Values of variables, or null
+void writeModelFile(const Model& m, const Model::Number* solution, std::ostream& out);
+
+/// Builds a Model from variables and expression trees
+class ModelWriter {
+public:
+	explicit ModelWriter(Model::ValueType type) { model.type= type; }
+
+	template <typename T>
+	void addVar(const BaseVar& var, T min, T max)
+	{
+		ensure(indices.find(&var) == indices.end());
+		indices[&var]= model.vars.size();
+		model.vars.push_back(
+				Model::VarDef{	toNumber(min, model.type),
+								toNumber(max, model.type)});
+	}
+
+	/// Starts a relation which is finished by `endRel`
+	void beginRel() { relBegin= model.instrs.size(); }
+	void endRel(std::int32_t priority)
+	{
+		std::uint32_t size= model.instrs.size() - relBegin;
+		model.rels.push_back(Model::RelDef{relBegin, size, priority, 0});
+	}
+
+	void var(const BaseVar& v)
+	{
+		auto it= indices.find(&v);
+		ensure(it != indices.end() && "Var not in model");
+		instr(Model::OpCode::var, it->second, Model::Number{});
+	}
+
+	template <typename T>
+	void constant(T value)
+	{ instr(Model::OpCode::constant, 0, toNumber(value, model.type)); }
+
+	void op(Model::OpCode code) { instr(code, 0, Model::Number{}); }
+
+	/// Copies instruction of another model of the same value type
+	/// Variables must be added with `var`
+	void copy(const Model::Instr& i)
+	{
+		ensure(i.op != Model::OpCode::var);
+		model.instrs.push_back(i);
+	}
+
+	Model& getModel() { return model; }
+
+private:
+	void instr(Model::OpCode code, std::uint32_t index, Model::Number value)
+	{
+		Model::Instr i= {};
+		i.op= code;
+		i.index= index;
+		i.value= value;
+		model.instrs.push_back(i);
+	}
+
+	Model model;
+	Map<const BaseVar*, std::uint32_t> indices;
+	std::uint32_t relBegin= 0;
+};
+
+template <typename Op>
+struct OpCodeOf;
+
+template <> struct OpCodeOf<Add> { static constexpr Model::OpCode value= Model::OpCode::add; };
+template <> struct OpCodeOf<Sub> { static constexpr Model::OpCode value= Model::OpCode::sub; };
+template <> struct OpCodeOf<Mul> { static constexpr Model::OpCode value= Model::OpCode::mul; };
+template <> struct OpCodeOf<Div> { static constexpr Model::OpCode value= Model::OpCode::div; };
+template <> struct OpCodeOf<Pos> { static constexpr Model::OpCode value= Model::OpCode::pos; };
+template <> struct OpCodeOf<Neg> { static constexpr Model::OpCode value= Model::OpCode::neg; };
+template <> struct OpCodeOf<Eq> { static constexpr Model::OpCode value= Model::OpCode::eq; };
+template <> struct OpCodeOf<Neq> { static constexpr Model::OpCode value= Model::OpCode::neq; };
+template <> struct OpCodeOf<Gr> { static constexpr Model::OpCode value= Model::OpCode::gr; };
+template <> struct OpCodeOf<Ls> { static constexpr Model::OpCode value= Model::OpCode::ls; };
+template <> struct OpCodeOf<Geq> { static constexpr Model::OpCode value= Model::OpCode::geq; };
+template <> struct OpCodeOf<Leq> { static constexpr Model::OpCode value= Model::OpCode::leq; };
+template <> struct OpCodeOf<And> { static constexpr Model::OpCode value= Model::OpCode::and_; };
+template <> struct OpCodeOf<Or> { static constexpr Model::OpCode value= Model::OpCode::or_; };
+template <> struct OpCodeOf<Not> { static constexpr Model::OpCode value= Model::OpCode::not_; };
+
+// Expressions to postfix instructions -conversions
+
+template <typename T>
+struct EmitInstrs {
+	static_assert(!sizeof(T), "Exporting particular expr not implemented");
+};
+
+template <typename T>
+struct EmitInstrs<Expr<T>> {
+	static void eval(ModelWriter& w, Expr<T> e)
+	{ EmitInstrs<T>::eval(w, e.get()); }
+};
+
+template <typename T, VarType type>
+struct EmitInstrs<Var<T, type>> {
+	static void eval(ModelWriter& w, Var<T, type>& v)
+	{ w.var(v); }
+};
+
+template <typename T>
+struct EmitInstrs<Constant<T>> {
+	static void eval(ModelWriter& w, Constant<T> c)
+	{ w.constant(c.get()); }
+};
+
+template <typename E, typename Op>
+struct EmitInstrs<UOp<E, Op>> {
+	static void eval(ModelWriter& w, UOp<E, Op> op)
+	{
+		EmitInstrs<E>::eval(w, op.e);
+		w.op(OpCodeOf<Op>::value);
+	}
+};
+
+/// Written as a chain of additions, as programs have only binary operators
+template <typename E, typename C>
+struct EmitInstrs<Sum<E, C>> {
+	static void eval(ModelWriter& w, Sum<E, C> e)
+	{
+		if (e.size() == 0)
+			w.constant(C{0});
+		for (std::size_t i= 0; i < e.size(); ++i) {
+			EmitInstrs<E>::eval(w, e.term(i));
+			if (e.coeffs) {
+				w.constant(e.coeff(i));
+				w.op(Model::OpCode::mul);
+			}
+			if (i > 0)
+				w.op(Model::OpCode::add);
+		}
+	}
+};
+
+template <typename E1, typename E2, typename Op>
+struct EmitInstrs<BiOp<E1, E2, Op>> {
+	static void eval(ModelWriter& w, BiOp<E1, E2, Op> op)
+	{
+		EmitInstrs<E1>::eval(w, op.lhs);
+		EmitInstrs<E2>::eval(w, op.rhs);
+		w.op(OpCodeOf<Op>::value);
+	}
+};
+
+} // detail
+
+/// Appends relation `e` to the model being written
+template <typename E>
+void emitRel(detail::ModelWriter& w, E e, std::int32_t priority)
+{
+	w.beginRel();
+	detail::EmitInstrs<E>::eval(w, e);
+	w.endRel(priority);
+}
+
+} // eq
+
+#endif // EQ_MODEL_HPP
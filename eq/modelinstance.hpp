@@ -0,0 +1,84 @@
+#ifndef EQ_MODELINSTANCE_HPP
+#define EQ_MODELINSTANCE_HPP
+
+#include "model.hpp"
+#include "rel.hpp"
+#include "var.hpp"
+
+namespace eq {
+
+/// Variables and relations of a model, without the objects it was exported from
+/// e.g. for replaying a model saved with `writeModel`
+template <typename T>
+class ModelInstance {
+public:
+	using Domain= typename Var<T>::Domain;
+
+	explicit ModelInstance(Model m)
+		: ModelInstance(std::make_shared<Model>(std::move(m))) { }
+
+	explicit ModelInstance(SharedPtr<const Model> model)
+	{
+		ensure(model->type == Model::typeOf<T>() && "Model type mismatch");
+
+		auto handles= std::make_shared<DynArray<VarHandle>>();
+		Set<BaseVar*> var_set;
+		for (std::size_t i= 0; i < model->vars.size(); ++i) {
+			vars.emplace_back(new Var<T>{});
+			handles->emplace_back(*vars.back());
+			var_set.insert(vars.back().get());
+		}
+
+		if (vars.empty())
+			return;
+
+		detail::DomainsLock lock{var_set};
+		auto&& domain= detail::mergeDomainsOf<Domain>(var_set);
+
+		// Unbounded variables are exported with the range of the solver
+		using Solver= typename Domain::Solver;
+		for (std::size_t i= 0; i < model->vars.size(); ++i) {
+			T min= numberAs<T>(model->vars[i].min, model->type);
+			T max= numberAs<T>(model->vars[i].max, model->type);
+			if (min > Solver::minValue())
+				domain.addRelation(*vars[i] >= min);
+			if (max < Solver::maxValue())
+				domain.addRelation(*vars[i] <= max);
+		}
+
+		for (std::size_t i= 0; i < model->rels.size(); ++i)
+			domain.template addProgram<Var<T>>(program(*model, i), model, handles);
+	}
+
+	std::size_t size() const { return vars.size(); }
+
+	/// Variables in the order of the model
+	const Var<T>& operator[](std::size_t i) const { return *vars[i]; }
+
+private:
+	DynArray<UniquePtr<Var<T>>> vars;
+};
+
+/// @return Model of the domain which `var` belongs to
+template <typename T, VarType type>
+Model exportModel(const Var<T, type>& var)
+{
+	using Domain= typename Var<T, type>::Domain;
+	auto lock= detail::lockDomainOf(var);
+	return static_cast<Domain&>(var.BaseVar::getDomain()).exportModel();
+}
+
+/// @param order Every variable of a domain, in the order of the model
+template <typename T>
+Model exportModel(const DynArray<const Var<T>*>& order)
+{
+	ensure(!order.empty());
+	using Domain= typename Var<T>::Domain;
+	auto lock= detail::lockDomainOf(*order.front());
+	auto&& domain= static_cast<Domain&>(order.front()->BaseVar::getDomain());
+	return domain.exportModel(DynArray<const BaseVar*>(order.begin(), order.end()));
+}
+
+} // eq
+
+#endif // EQ_MODELINSTANCE_HPP
@@ -0,0 +1,65 @@
+#include "ordering.hpp"
+
+namespace eq {
+namespace detail {
+
+bool resolve(const Ordering& o, std::size_t var_count, DynArray<int>& values)
+{
+	const int unset= std::numeric_limits<int>::min();
+	DynArray<int> min(var_count, unset);
+	DynArray<int> max(var_count, std::numeric_limits<int>::max());
+	for (auto&& b : o.bounds) {
+		ensure(b.var < var_count);
+		min[b.var]= std::max(min[b.var], b.min);
+		max[b.var]= std::min(max[b.var], b.max);
+	}
+
+	// Successors in compressed rows
+	DynArray<std::size_t> first(var_count + 1, 0);
+	DynArray<std::size_t> in_degree(var_count, 0);
+	for (auto&& pair : o.less) {
+		ensure(pair.first < var_count && pair.second < var_count);
+		++first[pair.first + 1];
+		++in_degree[pair.second];
+	}
+	for (std::size_t i= 0; i < var_count; ++i)
+		first[i + 1] += first[i];
+	DynArray<std::size_t> next(first.begin(), first.end() - 1);
+	DynArray<std::size_t> succ(o.less.size());
+	for (auto&& pair : o.less)
+		succ[next[pair.first]++]= pair.second;
+
+	// Kahn's algorithm, raising successors above their predecessors
+	DynArray<std::size_t> ready;
+	for (std::size_t i= 0; i < var_count; ++i) {
+		if (in_degree[i] == 0)
+			ready.push_back(i);
+	}
+
+	values.assign(var_count, 0);
+	std::size_t done= 0;
+	while (!ready.empty()) {
+		std::size_t v= ready.back();
+		ready.pop_back();
+		++done;
+
+		if (min[v] == unset || min[v] > max[v])
+			return false;
+		values[v]= min[v];
+
+		for (std::size_t i= first[v]; i < first[v + 1]; ++i) {
+			std::size_t s= succ[i];
+			if (values[v] == std::numeric_limits<int>::max())
+				return false;
+			min[s]= std::max(min[s], values[v] + 1);
+			if (--in_degree[s] == 0)
+				ready.push_back(s);
+		}
+	}
+
+	// Cycle
+	return done == var_count;
+}
+
+} // detail
+} // eq
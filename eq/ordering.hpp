@@ -0,0 +1,111 @@
+#ifndef EQ_ORDERING_HPP
+#define EQ_ORDERING_HPP
+
+#include "expr.hpp"
+#include "util.hpp"
+
+#include <limits>
+
+namespace eq {
+namespace detail {
+
+/// Relations of a domain consisting only of `<`, `>` and constant bounds
+/// between priority variables, which is solved without a solver
+/// Variables are referred by domain index.
+struct Ordering {
+	struct Bound {
+		std::size_t var;
+		int min;
+		int max;
+	};
+
+	/// Pairs (a, b) for which a < b
+	DynArray<std::pair<std::size_t, std::size_t>> less;
+	DynArray<Bound> bounds;
+};
+
+/// Gives every variable the smallest value which satisfies the ordering
+/// @return false if there's a cycle, a variable without lower bound,
+///         or an upper bound which can't be met
+bool resolve(const Ordering& o, std::size_t var_count, DynArray<int>& values);
+
+// Relations to ordering -conversions
+// `eval` returns false if relation isn't a pure ordering
+
+template <typename T>
+struct CollectOrdering {
+	static bool eval(T, Ordering&) { return false; }
+};
+
+template <typename T>
+struct CollectOrdering<Expr<T>> {
+	static bool eval(Expr<T> e, Ordering& o)
+	{ return CollectOrdering<T>::eval(e.get(), o); }
+};
+
+template <typename E1, typename E2>
+struct CollectOrdering<BiOp<E1, E2, And>> {
+	static bool eval(BiOp<E1, E2, And> op, Ordering& o)
+	{
+		return	CollectOrdering<E1>::eval(op.lhs, o) &&
+				CollectOrdering<E2>::eval(op.rhs, o);
+	}
+};
+
+template <typename T>
+using PriorityExpr= Expr<Var<T, VarType::priority>>;
+template <typename T>
+using ConstantExpr= Expr<Constant<T>>;
+
+template <typename T>
+struct CollectOrdering<BiOp<PriorityExpr<T>, PriorityExpr<T>, Ls>> {
+	static bool eval(BiOp<PriorityExpr<T>, PriorityExpr<T>, Ls> op, Ordering& o)
+	{
+		o.less.emplace_back(op.lhs.get().getIndex(), op.rhs.get().getIndex());
+		return true;
+	}
+};
+
+template <typename T>
+struct CollectOrdering<BiOp<PriorityExpr<T>, PriorityExpr<T>, Gr>> {
+	static bool eval(BiOp<PriorityExpr<T>, PriorityExpr<T>, Gr> op, Ordering& o)
+	{
+		o.less.emplace_back(op.rhs.get().getIndex(), op.lhs.get().getIndex());
+		return true;
+	}
+};
+
+template <typename T>
+struct CollectOrdering<BiOp<PriorityExpr<T>, ConstantExpr<T>, Gr>> {
+	static bool eval(BiOp<PriorityExpr<T>, ConstantExpr<T>, Gr> op, Ordering& o)
+	{
+		T c= op.rhs.get().get();
+		if (c == std::numeric_limits<T>::max())
+			return false;
+		o.bounds.push_back(
+			Ordering::Bound{	op.lhs.get().getIndex(),
+								c + 1,
+								std::numeric_limits<int>::max()});
+		return true;
+	}
+};
+
+template <typename T>
+struct CollectOrdering<BiOp<PriorityExpr<T>, ConstantExpr<T>, Ls>> {
+	static bool eval(BiOp<PriorityExpr<T>, ConstantExpr<T>, Ls> op, Ordering& o)
+	{
+		T c= op.rhs.get().get();
+		if (c == std::numeric_limits<T>::min())
+			return false;
+		o.bounds.push_back(
+			Ordering::Bound{	op.lhs.get().getIndex(),
+								std::numeric_limits<int>::min(),
+								c - 1});
+		return true;
+	}
+};
+
+} // detail
+} // eq
+
+#endif // EQ_ORDERING_HPP
@@ -0,0 +1,68 @@
+#ifndef EQ_POOL_HPP
+#define EQ_POOL_HPP
+
+#include "util.hpp"
+
+#include <cstddef>
+#include <new>
+
+namespace eq {
+namespace detail {
+
+/// Recycles freed memory blocks of `size` bytes
+/// Shared by all threads; the lock is held only for unlinking a block.
+/// At most `maxFree` blocks are kept, the rest are returned to the heap.
+template <std::size_t size>
+class FreeList {
+public:
+	static void* allocate()
+	{
+		{
+			std::lock_guard<SpinLock> guard(lock);
+			if (Node* n= head) {
+				head= n->next;
+				--count;
+				return n;
+			}
+		}
+		return ::operator new(size);
+	}
+
+	static void deallocate(void* p)
+	{
+		{
+			std::lock_guard<SpinLock> guard(lock);
+			if (count < maxFree) {
+				head= new (p) Node{head};
+				++count;
+				return;
+			}
+		}
+		::operator delete(p);
+	}
+
+private:
+	static_assert(size >= sizeof(void*), "Block too small for a freelist");
+	static constexpr std::size_t maxFree= 1024;
+
+	struct Node {
+		Node* next;
+	};
+
+	// Trivially destructible, so that blocks can be freed during exit
+	static SpinLock lock;
+	static Node* head;
+	static std::size_t count;
+};
+
+template <std::size_t size>
+SpinLock FreeList<size>::lock;
+template <std::size_t size>
+typename FreeList<size>::Node* FreeList<size>::head= nullptr;
+template <std::size_t size>
+std::size_t FreeList<size>::count= 0;
+
+} // detail
+} // eq
+
+#endif // EQ_POOL_HPP
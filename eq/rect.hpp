@@ -0,0 +1,198 @@
+#ifndef EQ_RECT_HPP
+#define EQ_RECT_HPP
+
+#include "constraintsolver.hpp"
+#include "expr.hpp"
+#include "linearsolver.hpp"
+#include "model.hpp"
+#include "var.hpp"
+
+namespace eq {
+
+/// Axis-aligned rectangle of variables
+template <typename T>
+struct Rect {
+	Rect(	const Var<T>& left, const Var<T>& bottom,
+			const Var<T>& right, const Var<T>& top)
+		: left(expr(left)), bottom(expr(bottom))
+		, right(expr(right)), top(expr(top))
+	{ }
+
+	Expr<Var<T>> left, bottom, right, top;
+
+	Set<BaseVar*> getVars() const
+	{
+		return	left.getVars() + bottom.getVars() +
+				right.getVars() + top.getVars();
+	}
+
+	bool refersTo(const BaseVar& var) const
+	{
+		return	left.refersTo(var) || bottom.refersTo(var) ||
+				right.refersTo(var) || top.refersTo(var);
+	}
+};
+
+/// Relation of `inner` being inside `outer`
+/// Same as four comparisons of sides, but posted as one constraint
+/// which propagates all sides together
+template <typename T>
+struct Contains {
+	using Domain= typename Var<T>::Domain;
+
+	Rect<T> outer;
+	Rect<T> inner;
+
+	Set<BaseVar*> getVars() const { return outer.getVars() + inner.getVars(); }
+	bool refersTo(const BaseVar& var) const
+	{ return outer.refersTo(var) || inner.refersTo(var); }
+
+	bool eval() const
+	{
+		return	outer.left.eval() <= inner.left.eval() &&
+				outer.bottom.eval() <= inner.bottom.eval() &&
+				inner.right.eval() <= outer.right.eval() &&
+				inner.top.eval() <= outer.top.eval();
+	}
+};
+
+/// Relation of rectangles not overlapping
+/// Not supported by LinearSolver because it's not convex
+template <typename T>
+struct Disjoint {
+	using Domain= typename Var<T>::Domain;
+
+	Rect<T> a;
+	Rect<T> b;
+
+	Set<BaseVar*> getVars() const { return a.getVars() + b.getVars(); }
+	bool refersTo(const BaseVar& var) const
+	{ return a.refersTo(var) || b.refersTo(var); }
+
+	bool eval() const
+	{
+		return	a.right.eval() <= b.left.eval() ||
+				b.right.eval() <= a.left.eval() ||
+				a.top.eval() <= b.bottom.eval() ||
+				b.top.eval() <= a.bottom.eval();
+	}
+};
+
+template <typename T>
+Expr<Contains<T>> contains(const Rect<T>& outer, const Rect<T>& inner)
+{ return Contains<T>{outer, inner}; }
+
+template <typename T>
+Expr<Disjoint<T>> disjoint(const Rect<T>& a, const Rect<T>& b)
+{ return Disjoint<T>{a, b}; }
+
+namespace detail {
+
+template <typename T>
+struct IsRelation<Expr<Contains<T>>> { static constexpr bool value= true; };
+
+template <typename T>
+struct IsRelation<Expr<Disjoint<T>>> { static constexpr bool value= true; };
+
+template <typename T>
+struct Degree<Contains<T>> { static constexpr int value= 1; };
+
+template <typename T>
+struct MakeConRel<Rect<T>> {
+	static RectVars eval(ConstraintSolver& self, Rect<T> r, Priority p)
+	{
+		return RectVars{{	self.makeRel(r.left, p), self.makeRel(r.bottom, p),
+							self.makeRel(r.right, p), self.makeRel(r.top, p)}};
+	}
+};
+
+template <typename T>
+struct MakeConRel<Contains<T>> {
+	static void eval(ConstraintSolver& self, Contains<T> c, Priority p)
+	{
+		auto outer= self.makeRel(c.outer, p);
+		auto inner= self.makeRel(c.inner, p);
+		if (p.hard())
+			self.solver.AddConstraint(makeContains(self.solver, outer, inner));
+		else
+			self.addSuccessVar(makeContainsVar(self.solver, outer, inner), p);
+	}
+};
+
+template <typename T>
+struct MakeConRel<Disjoint<T>> {
+	static void eval(ConstraintSolver& self, Disjoint<T> d, Priority p)
+	{
+		auto a= self.makeRel(d.a, p);
+		auto b= self.makeRel(d.b, p);
+		if (p.hard())
+			self.solver.AddConstraint(makeDisjoint(self.solver, a, b));
+		else
+			self.addSuccessVar(makeDisjointVar(self.solver, a, b), p);
+	}
+};
+
+template <typename T>
+struct MakeLinRel<Contains<T>> {
+	static void eval(LinearSolver& self, Contains<T> c)
+	{
+		leq(self, c.outer.left, c.inner.left);
+		leq(self, c.outer.bottom, c.inner.bottom);
+		leq(self, c.inner.right, c.outer.right);
+		leq(self, c.inner.top, c.outer.top);
+	}
+
+	static void leq(LinearSolver& self, Expr<Var<T>> lhs, Expr<Var<T>> rhs)
+	{
+		auto c= self.solver.MakeRowConstraint(-self.solver.infinity(), 0.0);
+		self.makeRel(lhs, c, 1.0);
+		self.makeRel(rhs, c, -1.0);
+	}
+};
+
+template <typename T>
+struct MakeLinRel<Disjoint<T>> {
+	static_assert(!sizeof(T), "LinearSolver can't solve non-overlap");
+};
+
+template <typename T>
+void emitLeq(ModelWriter& w, Expr<Var<T>> lhs, Expr<Var<T>> rhs)
+{
+	EmitInstrs<Expr<Var<T>>>::eval(w, lhs);
+	EmitInstrs<Expr<Var<T>>>::eval(w, rhs);
+	w.op(Model::OpCode::leq);
+}
+
+/// Models have no global constraints, so sides are compared one by one
+template <typename T>
+struct EmitInstrs<Contains<T>> {
+	static void eval(ModelWriter& w, Contains<T> c)
+	{
+		emitLeq(w, c.outer.left, c.inner.left);
+		emitLeq(w, c.outer.bottom, c.inner.bottom);
+		w.op(Model::OpCode::and_);
+		emitLeq(w, c.inner.right, c.outer.right);
+		w.op(Model::OpCode::and_);
+		emitLeq(w, c.inner.top, c.outer.top);
+		w.op(Model::OpCode::and_);
+	}
+};
+
+template <typename T>
+struct EmitInstrs<Disjoint<T>> {
+	static void eval(ModelWriter& w, Disjoint<T> d)
+	{
+		emitLeq(w, d.a.right, d.b.left);
+		emitLeq(w, d.b.right, d.a.left);
+		w.op(Model::OpCode::or_);
+		emitLeq(w, d.a.top, d.b.bottom);
+		w.op(Model::OpCode::or_);
+		emitLeq(w, d.b.top, d.a.bottom);
+		w.op(Model::OpCode::or_);
+	}
+};
+
+} // detail
+} // eq
+
+#endif // EQ_RECT_HPP
@@ -0,0 +1,141 @@
+#ifndef EQ_REFPTR_HPP
+#define EQ_REFPTR_HPP
+
+#include "util.hpp"
+
+#include <cstddef>
+
+/// Define EQ_ATOMIC_REFCOUNT when domains are used from several threads,
+/// i.e. built in parallel with `rel` or read through `sharedDomain`.
+/// Without it reference counts and domain pointers of variables aren't
+/// synchronized, which keeps merging and moving variables cheap.
+/// Background and parallel solving don't need it, as their threads
+/// don't touch domains.
+
+namespace eq {
+namespace detail {
+
+/// Lock which does nothing, for builds without EQ_ATOMIC_REFCOUNT
+struct NoLock {
+	void lock() { }
+	void unlock() { }
+};
+
+#ifdef EQ_ATOMIC_REFCOUNT
+using RefCount= std::atomic<std::size_t>;
+/// Guards pointers which are shared between threads, see `BaseVar`
+using RefLock= SpinLock;
+constexpr bool atomicRefCount= true;
+#else
+using RefCount= std::size_t;
+using RefLock= NoLock;
+/// Checked by functions which are only for other threads
+constexpr bool atomicRefCount= false;
+#endif
+
+} // detail
+
+template <typename T>
+class RefPtr;
+
+/// Base of objects owned by RefPtr
+/// Count is embedded in the object, so RefPtr is a single pointer and
+/// can be made from `this`
+class RefCounted {
+public:
+	RefCounted()= default;
+	RefCounted(const RefCounted&) { }
+	RefCounted& operator=(const RefCounted&) { return *this; }
+
+protected:
+	~RefCounted()= default;
+
+private:
+	template <typename T>
+	friend class RefPtr;
+
+	void retain() const { ++refs; }
+	/// @return true if the last reference was released
+	bool release() const { return --refs == 0; }
+
+	mutable detail::RefCount refs{0};
+};
+
+/// Intrusive shared pointer to a RefCounted object
+/// Object is deleted with `delete` when the last RefPtr goes away
+template <typename T>
+class RefPtr {
+public:
+	RefPtr()= default;
+	RefPtr(std::nullptr_t) { }
+	explicit RefPtr(T* p)
+		: ptr(p) { retain(); }
+
+	RefPtr(const RefPtr& other)
+		: ptr(other.ptr) { retain(); }
+	RefPtr(RefPtr&& other)
+		: ptr(other.ptr) { other.ptr= nullptr; }
+
+	template <typename U>
+	RefPtr(const RefPtr<U>& other)
+		: ptr(other.get()) { retain(); }
+	template <typename U>
+	RefPtr(RefPtr<U>&& other)
+		: ptr(other.release()) { }
+
+	~RefPtr() { reset(); }
+
+	RefPtr& operator=(RefPtr other)
+	{
+		swap(other);
+		return *this;
+	}
+
+	void reset()
+	{
+		if (ptr && ptr->release())
+			delete ptr;
+		ptr= nullptr;
+	}
+
+	void swap(RefPtr& other) { std::swap(ptr, other.ptr); }
+
+	/// Gives up ownership without releasing
+	T* release()
+	{
+		T* p= ptr;
+		ptr= nullptr;
+		return p;
+	}
+
+	T* get() const { return ptr; }
+	T& operator*() const { return *ptr; }
+	T* operator->() const { return ptr; }
+	explicit operator bool() const { return ptr != nullptr; }
+
+private:
+	void retain()
+	{
+		if (ptr)
+			ptr->retain();
+	}
+
+	T* ptr= nullptr;
+};
+
+template <typename T, typename U>
+bool operator==(const RefPtr<T>& a, const RefPtr<U>& b) { return a.get() == b.get(); }
+template <typename T, typename U>
+bool operator!=(const RefPtr<T>& a, const RefPtr<U>& b) { return a.get() != b.get(); }
+/// For ordered containers, e.g. locking domains in address order
+template <typename T>
+bool operator<(const RefPtr<T>& a, const RefPtr<T>& b)
+{ return std::less<T*>()(a.get(), b.get()); }
+
+template <typename T, typename U>
+RefPtr<T> staticPtrCast(const RefPtr<U>& p)
+{ return RefPtr<T>{static_cast<T*>(p.get())}; }
+
+} // eq
+
+#endif // EQ_REFPTR_HPP
@@ -7,13 +7,14 @@
 namespace eq {
 namespace detail {
 
-template <typename E>
-DomainOf<E>& mergeDomains(E&& e)
+/// Merges domains of `vars` into one
+/// Domains must be locked, see `DomainsLock`
+template <typename Domain>
+Domain& mergeDomainsOf(const Set<BaseVar*>& vars)
 {
-	auto&& base_ds= domains(e.getVars());
+	auto&& base_ds= domains(vars);
 	ensure(!base_ds.empty() && "Domain not found");
 
-	using Domain= DomainOf<E>;
 	DynArray<Domain*> ds;
 	for (auto&& d : base_ds)
 		ds.push_back(&static_cast<Domain&>(*d));
@@ -33,19 +34,88 @@ DomainOf<E>& mergeDomains(E&& e)
 } // detail
 
 /// Register expression as relation
+/// Relations of independent domains can be added from different threads
+/// if built with EQ_ATOMIC_REFCOUNT, see refptr.hpp
+/// @return Handle for removing the relation, can be ignored
 template <typename E>
-void rel(E e)
+RelHandle rel(E e)
 {
 	static_assert(isRelation<E>(), "Expression is not a relation");
-	detail::mergeDomains(e).addRelation(e);
+	auto&& vars= e.getVars();
+	detail::DomainsLock lock{vars};
+	return detail::mergeDomainsOf<DomainOf<E>>(vars).addRelation(e);
 }
 
 /// Register expression as a soft relation
+/// Domain of `priority` is locked separately when solving, so priority
+/// domains have to be built before relations using them are solved
 template <typename E>
-void rel(E e, PriorityVar& priority)
+RelHandle rel(E e, PriorityVar& priority)
 {
 	static_assert(isRelation<E>(), "Expression is not a relation");
-	detail::mergeDomains(e).addRelation(e, priority);
+	auto&& vars= e.getVars();
+	detail::DomainsLock lock{vars};
+	return detail::mergeDomainsOf<DomainOf<E>>(vars).addRelation(e, priority);
+}
+
+/// Sets options of the solver of the domain of `var`
+/// Set after relations, because merging domains keeps options of only one
+template <typename T, VarType type>
+void setSolverOptions(
+		Var<T, type>& var,
+		const typename Var<T, type>::Domain::Solver::Options& options)
+{
+	using Domain= typename Var<T, type>::Domain;
+	auto lock= detail::lockDomainOf(var);
+	static_cast<Domain&>(var.BaseVar::getDomain()).setOptions(options);
+}
+
+/// @return Domain of `var`, for reading snapshots of solved values in
+///         other threads, see `Domain::snapshot` and EQ_ATOMIC_REFCOUNT.
+///         Get a new one after merging relations, because merged
+///         domains aren't solved.
+template <typename T, VarType type>
+DomainPtr<typename Var<T, type>::Domain::Solver> sharedDomain(const Var<T, type>& var)
+{
+	using Domain= typename Var<T, type>::Domain;
+	return staticPtrCast<Domain>(detail::domainOf(var));
+}
+
+/// Makes `var` follow `suggestValue` until `endEdit`, e.g. while dragging
+/// Domain of `var` is then solved incrementally, see IncrementalSolver
+template <typename T, VarType type>
+void beginEdit(Var<T, type>& var)
+{
+	using Domain= typename Var<T, type>::Domain;
+	auto lock= detail::lockDomainOf(var);
+	static_cast<Domain&>(var.BaseVar::getDomain()).beginEdit(var);
+}
+
+/// Moves edited `var` as close to `value` as relations allow
+/// Solved when a value of the domain is read next time.
+template <typename T, VarType type>
+void suggestValue(Var<T, type>& var, T value)
+{
+	using Domain= typename Var<T, type>::Domain;
+	auto lock= detail::lockDomainOf(var);
+	static_cast<Domain&>(var.BaseVar::getDomain()).suggestValue(var, value);
+}
+
+template <typename T, VarType type>
+void endEdit(Var<T, type>& var)
+{
+	using Domain= typename Var<T, type>::Domain;
+	auto lock= detail::lockDomainOf(var);
+	static_cast<Domain&>(var.BaseVar::getDomain()).endEdit(var);
+}
+
+/// @return Solver which produced the current value of `var`
+template <typename T, VarType type>
+Backend solvedBy(const Var<T, type>& var)
+{
+	using Domain= typename Var<T, type>::Domain;
+	auto lock= detail::lockDomainOf(var);
+	return static_cast<const Domain&>(var.BaseVar::getDomain()).getBackend();
 }
 
 } // eq
@@ -0,0 +1,61 @@
+#include "domain.hpp"
+#include "relhandle.hpp"
+
+namespace eq {
+
+RelHandle& RelHandle::operator=(RelHandle&& other)
+{
+	if (this != &other) {
+		release();
+
+		setDomain(other.getDomainPtr().get());
+		record= other.record;
+		liveBegin= other.liveBegin;
+		liveEnd= other.liveEnd;
+		if (record)
+			record->handle= this;
+
+		other.setDomain(nullptr);
+		other.record= nullptr;
+	}
+	return *this;
+}
+
+void RelHandle::remove()
+{
+	// Merging drops the old domain only after moving the relation, so a
+	// domain referenced here stays alive until locked
+	while (BaseDomainPtr d= getDomainPtr()) {
+		std::lock_guard<std::mutex> lock(d->getMutex());
+		if (d != getDomainPtr())
+			continue;
+
+		if (record) {
+			d->removeRel(*record);
+			ensure(!record && "Storage didn't clear the handle");
+		}
+		return;
+	}
+}
+
+void RelHandle::release()
+{
+	if (record)
+		record->handle= nullptr;
+	setDomain(nullptr);
+	record= nullptr;
+}
+
+void RelHandle::setDomain(BaseDomain* d)
+{
+	std::lock_guard<detail::RefLock> lock(domainLock);
+	domain= d;
+}
+
+BaseDomainPtr RelHandle::getDomainPtr() const
+{
+	std::lock_guard<detail::RefLock> lock(domainLock);
+	return BaseDomainPtr{domain};
+}
+
+} // eq
@@ -0,0 +1,73 @@
+#ifndef EQ_RELHANDLE_HPP
+#define EQ_RELHANDLE_HPP
+
+#include "basevar.hpp"
+#include "util.hpp"
+
+namespace eq {
+
+class BaseDomain;
+class RelHandle;
+
+template <typename S>
+class Domain;
+template <typename S>
+class RelStorage;
+
+namespace detail {
+
+/// Part of the header of a stored relation which the handle refers to
+struct RelHeader {
+	RelHandle* handle;
+};
+
+} // detail
+
+/// Handle to a relation added with `rel()`
+/// Follows the relation when it's relocated or its domain is merged.
+/// The relation isn't removed when the handle is destroyed.
+class RelHandle {
+public:
+	RelHandle()= default;
+	~RelHandle() { release(); }
+
+	RelHandle(const RelHandle&)= delete;
+	RelHandle& operator=(const RelHandle&)= delete;
+
+	RelHandle(RelHandle&& other) { operator=(std::move(other)); }
+	RelHandle& operator=(RelHandle&& other);
+
+	/// Removes the relation, and only it, from its domain
+	/// Does nothing if the relation has already been removed
+	/// Locks the domain, which may be merged meanwhile in another thread
+	void remove();
+
+	/// Detaches the handle, leaving the relation in place
+	void release();
+
+	/// @return true if the relation still exists
+	explicit operator bool() const { return record != nullptr; }
+
+private:
+	template <typename S>
+	friend class Domain;
+	template <typename S>
+	friend class RelStorage;
+
+	/// Guarded, because merging in another thread may move the relation
+	void setDomain(BaseDomain* d);
+	/// Keeps the domain alive while it's being locked, see `remove`
+	BaseDomainPtr getDomainPtr() const;
+
+	/// Changed by merging in the thread which holds the domain lock
+	BaseDomain* domain= nullptr;
+	mutable detail::RefLock domainLock;
+	detail::RelHeader* record= nullptr;
+	/// Position of the relation in the solver retained by the domain
+	std::size_t liveBegin= 0;
+	std::size_t liveEnd= 0;
+};
+
+} // eq
+
+#endif // EQ_RELHANDLE_HPP
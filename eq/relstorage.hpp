@@ -0,0 +1,172 @@
+#ifndef EQ_RELSTORAGE_HPP
+#define EQ_RELSTORAGE_HPP
+
+#include "basevar.hpp"
+#include "model.hpp"
+#include "ordering.hpp"
+#include "relhandle.hpp"
+#include "util.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+namespace eq {
+
+/// Contiguous storage of type-erased relation records
+/// Records are placed inline in blocks, first of which is inside the storage
+/// itself, so small domains don't allocate and replaying is mostly sequential
+/// memory access. Records are relocated only on compaction and `append`.
+/// Handles of records are kept pointing to them.
+///
+/// Record type R needs
+///   void post(S& solver) const
+///   bool refersTo(const BaseVar& var) const
+///   void emit(detail::ModelWriter& w) const
+///   bool collectOrdering(detail::Ordering& o) const
+///   bool linear() const
+template <typename S>
+class RelStorage {
+public:
+	using Solver= S;
+
+	/// @param owner Domain given to handles of records
+	explicit RelStorage(BaseDomain& owner);
+	~RelStorage() { clear(); }
+
+	RelStorage(const RelStorage&)= delete;
+	RelStorage& operator=(const RelStorage&)= delete;
+
+	/// @param handle Linked to the record if not null
+	template <typename R>
+	void add(R rec, RelHandle* handle= nullptr);
+
+	/// Posts every record to `solver` in the order of adding
+	void post(Solver& solver) const;
+
+	/// Calls also `posted(header)` after posting each record
+	template <typename F>
+	void post(Solver& solver, F&& posted) const;
+
+	/// Removes single record in constant time
+	void erase(detail::RelHeader& rec);
+
+	/// Appends every record to the model being written
+	void emit(detail::ModelWriter& w) const;
+
+	/// Calls also `emitted(header)` after emitting each record
+	template <typename F>
+	void emit(detail::ModelWriter& w, F&& emitted) const;
+
+	/// @return false if some record isn't a pure ordering
+	bool collectOrdering(detail::Ordering& o) const;
+
+	/// @return true if every record is hard and linear
+	bool linear() const;
+
+	/// Removes records which refer to `var`
+	void eraseReferring(const BaseVar& var);
+
+	/// Moves all records of `other` to the end of this
+	void append(RelStorage&& other);
+
+	void clear();
+
+	std::size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+
+private:
+	using Align= std::max_align_t;
+
+	struct Ops {
+		void (*post)(const void* rec, Solver& solver);
+		bool (*refersTo)(const void* rec, const BaseVar& var);
+		void (*emit)(const void* rec, detail::ModelWriter& w);
+		bool (*collectOrdering)(const void* rec, detail::Ordering& o);
+		bool (*linear)(const void* rec);
+		/// Move-constructs to `dst` and destroys `src`
+		void (*relocate)(void* dst, void* src);
+		void (*destroy)(void* rec);
+	};
+
+	template <typename R>
+	struct OpsOf {
+		static void post(const void* rec, Solver& solver)
+		{ static_cast<const R*>(rec)->post(solver); }
+
+		static bool refersTo(const void* rec, const BaseVar& var)
+		{ return static_cast<const R*>(rec)->refersTo(var); }
+
+		static void emit(const void* rec, detail::ModelWriter& w)
+		{ static_cast<const R*>(rec)->emit(w); }
+
+		static bool collectOrdering(const void* rec, detail::Ordering& o)
+		{ return static_cast<const R*>(rec)->collectOrdering(o); }
+
+		static bool linear(const void* rec)
+		{ return static_cast<const R*>(rec)->linear(); }
+
+		static void relocate(void* dst, void* src)
+		{
+			R& src_rec= *static_cast<R*>(src);
+			new (dst) R(std::move(src_rec));
+			src_rec.~R();
+		}
+
+		static void destroy(void* rec)
+		{ static_cast<R*>(rec)->~R(); }
+
+		static const Ops ops;
+	};
+
+	/// Precedes every record. Dead records have null `ops`.
+	struct Header : detail::RelHeader {
+		const Ops* ops;
+		std::size_t size;
+	};
+
+	struct Block {
+		Align* data;
+		std::size_t capacity;
+		std::size_t used;
+	};
+
+	static constexpr std::size_t inlineCapacity= 256;
+
+	static constexpr std::size_t aligned(std::size_t bytes)
+	{ return (bytes + sizeof(Align) - 1)/sizeof(Align)*sizeof(Align); }
+
+	static constexpr std::size_t headerSize() { return aligned(sizeof(Header)); }
+
+	static void* payload(Header* h)
+	{ return reinterpret_cast<char*>(h) + headerSize(); }
+	static const void* payload(const Header* h)
+	{ return reinterpret_cast<const char*>(h) + headerSize(); }
+
+	/// Reserves `size` bytes, adding a block if necessary
+	Header* allocate(std::size_t size);
+	void kill(Header* h);
+	/// Moves `src` to `dst`, which has been allocated
+	void relocate(Header* dst, Header* src);
+	/// Removes dead records if they take too much space
+	void compactIfSparse();
+	void compact();
+
+	template <typename F>
+	void forEach(F&& f) const;
+
+	BaseDomain* owner;
+	Align inlineBlock[inlineCapacity/sizeof(Align)];
+	DynArray<Block> blocks;
+	/// Storage of blocks other than the inline one
+	DynArray<UniquePtr<Align[]>> heapBlocks;
+	std::size_t count= 0;
+	std::size_t deadBytes= 0;
+	std::size_t usedBytes= 0;
+};
+
+#include "relstorage.tpp"
+
+} // eq
+
+#endif // EQ_RELSTORAGE_HPP
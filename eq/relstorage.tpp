@@ -0,0 +1,283 @@
+template <typename S>
+template <typename R>
+const typename RelStorage<S>::Ops RelStorage<S>::OpsOf<R>::ops= {
+	&OpsOf<R>::post,
+	&OpsOf<R>::refersTo,
+	&OpsOf<R>::emit,
+	&OpsOf<R>::collectOrdering,
+	&OpsOf<R>::linear,
+	&OpsOf<R>::relocate,
+	&OpsOf<R>::destroy
+};
+
+template <typename S>
+RelStorage<S>::RelStorage(BaseDomain& owner)
+	: owner(&owner)
+{
+	blocks.push_back(Block{inlineBlock, inlineCapacity, 0});
+}
+
+template <typename S>
+template <typename R>
+void RelStorage<S>::add(R rec, RelHandle* handle)
+{
+	static_assert(alignof(R) <= alignof(Align), "Record is overaligned");
+	Header* h= allocate(headerSize() + aligned(sizeof(R)));
+	new (payload(h)) R(std::move(rec));
+	h->ops= &OpsOf<R>::ops;
+	++count;
+
+	if (handle) {
+		handle->release();
+		handle->setDomain(owner);
+		handle->record= h;
+		h->handle= handle;
+	}
+}
+
+template <typename S>
+void RelStorage<S>::post(Solver& solver) const
+{
+	forEach([&solver] (Header* h)
+	{ h->ops->post(payload(h), solver); });
+}
+
+template <typename S>
+template <typename F>
+void RelStorage<S>::post(Solver& solver, F&& posted) const
+{
+	forEach([&solver, &posted] (Header* h)
+	{
+		h->ops->post(payload(h), solver);
+		posted(static_cast<const detail::RelHeader&>(*h));
+	});
+}
+
+template <typename S>
+void RelStorage<S>::erase(detail::RelHeader& rec)
+{
+	kill(static_cast<Header*>(&rec));
+	compactIfSparse();
+}
+
+template <typename S>
+void RelStorage<S>::emit(detail::ModelWriter& w) const
+{
+	forEach([&w] (Header* h)
+	{ h->ops->emit(payload(h), w); });
+}
+
+template <typename S>
+template <typename F>
+void RelStorage<S>::emit(detail::ModelWriter& w, F&& emitted) const
+{
+	forEach([&w, &emitted] (Header* h)
+	{
+		h->ops->emit(payload(h), w);
+		emitted(static_cast<const detail::RelHeader&>(*h));
+	});
+}
+
+template <typename S>
+bool RelStorage<S>::collectOrdering(detail::Ordering& o) const
+{
+	bool ordering= true;
+	forEach([&o, &ordering] (Header* h)
+	{
+		if (ordering)
+			ordering= h->ops->collectOrdering(payload(h), o);
+	});
+	return ordering;
+}
+
+template <typename S>
+bool RelStorage<S>::linear() const
+{
+	bool linear= true;
+	forEach([&linear] (Header* h)
+	{
+		if (linear)
+			linear= h->ops->linear(payload(h));
+	});
+	return linear;
+}
+
+template <typename S>
+void RelStorage<S>::eraseReferring(const BaseVar& var)
+{
+	forEach([this, &var] (Header* h)
+	{
+		if (h->ops->refersTo(payload(h), var))
+			kill(h);
+	});
+	compactIfSparse();
+}
+
+template <typename S>
+void RelStorage<S>::append(RelStorage&& other)
+{
+	ensure(this != &other);
+	other.forEach([this] (Header* src)
+	{
+		Header* dst= allocate(src->size);
+		relocate(dst, src);
+		if (dst->handle)
+			dst->handle->setDomain(owner);
+		++count;
+	});
+
+	// Records have been relocated, so nothing to destroy
+	other.blocks.resize(1);
+	other.blocks.front().used= 0;
+	other.heapBlocks.clear();
+	other.count= 0;
+	other.deadBytes= 0;
+	other.usedBytes= 0;
+}
+
+template <typename S>
+void RelStorage<S>::clear()
+{
+	forEach([] (Header* h)
+	{
+		if (h->handle) {
+			h->handle->record= nullptr;
+			h->handle->setDomain(nullptr);
+		}
+		h->ops->destroy(payload(h));
+	});
+
+	blocks.resize(1);
+	blocks.front().used= 0;
+	heapBlocks.clear();
+	count= 0;
+	deadBytes= 0;
+	usedBytes= 0;
+}
+
+template <typename S>
+auto RelStorage<S>::allocate(std::size_t size) -> Header*
+{
+	ensure(size == aligned(size));
+	Block* block= &blocks.back();
+	if (block->used + size > block->capacity) {
+		std::size_t capacity= std::max(size, block->capacity*2);
+		heapBlocks.emplace_back(new Align[capacity/sizeof(Align)]);
+		blocks.push_back(Block{heapBlocks.back().get(), capacity, 0});
+		block= &blocks.back();
+	}
+
+	Header* h= reinterpret_cast<Header*>(
+			reinterpret_cast<char*>(block->data) + block->used);
+	h->handle= nullptr;
+	h->ops= nullptr;
+	h->size= size;
+	block->used += size;
+	usedBytes += size;
+	return h;
+}
+
+template <typename S>
+void RelStorage<S>::kill(Header* h)
+{
+	ensure(h->ops);
+	if (h->handle) {
+		h->handle->record= nullptr;
+		h->handle->setDomain(nullptr);
+		h->handle= nullptr;
+	}
+	h->ops->destroy(payload(h));
+	h->ops= nullptr;
+	deadBytes += h->size;
+	--count;
+}
+
+template <typename S>
+void RelStorage<S>::relocate(Header* dst, Header* src)
+{
+	dst->ops= src->ops;
+	dst->size= src->size;
+	dst->handle= src->handle;
+	if (dst->handle)
+		dst->handle->record= dst;
+	src->ops->relocate(payload(dst), payload(src));
+}
+
+template <typename S>
+void RelStorage<S>::compactIfSparse()
+{
+	if (deadBytes > 0 && deadBytes*2 >= usedBytes)
+		compact();
+}
+
+template <typename S>
+void RelStorage<S>::compact()
+{
+	DynArray<Align> scratch;
+	std::size_t dst_block= 0;
+	std::size_t dst_used= 0;
+
+	for (std::size_t src_block= 0; src_block < blocks.size(); ++src_block) {
+		char* src_data= reinterpret_cast<char*>(blocks[src_block].data);
+		std::size_t src_used= blocks[src_block].used;
+
+		for (std::size_t offset= 0; offset < src_used;) {
+			Header* src= reinterpret_cast<Header*>(src_data + offset);
+			const Ops* ops= src->ops;
+			std::size_t size= src->size;
+			offset += size;
+			if (!ops)
+				continue;
+
+			// Earlier blocks may be too small for the record, but its own
+			// block is reached at the latest, where it fits at its offset
+			while (dst_used + size > blocks[dst_block].capacity) {
+				blocks[dst_block].used= dst_used;
+				++dst_block;
+				dst_used= 0;
+			}
+
+			char* dst_data= reinterpret_cast<char*>(blocks[dst_block].data);
+			Header* dst= reinterpret_cast<Header*>(dst_data + dst_used);
+			dst_used += size;
+			if (dst == src)
+				continue;
+
+			bool overlaps= dst_block == src_block &&
+				reinterpret_cast<char*>(dst) + size > reinterpret_cast<char*>(src);
+			if (overlaps) {
+				// Header is copied to scratch too, so that it isn't overwritten
+				scratch.resize(size/sizeof(Align));
+				Header* tmp= reinterpret_cast<Header*>(scratch.data());
+				relocate(tmp, src);
+				relocate(dst, tmp);
+			} else {
+				relocate(dst, src);
+			}
+		}
+	}
+	blocks[dst_block].used= dst_used;
+
+	// Drop heap blocks which became empty
+	blocks.resize(dst_block + 1);
+	heapBlocks.resize(dst_block);
+
+	usedBytes -= deadBytes;
+	deadBytes= 0;
+}
+
+template <typename S>
+template <typename F>
+void RelStorage<S>::forEach(F&& f) const
+{
+	for (auto&& block : blocks) {
+		char* data= reinterpret_cast<char*>(block.data);
+		for (std::size_t offset= 0; offset < block.used;) {
+			Header* h= reinterpret_cast<Header*>(data + offset);
+			offset += h->size;
+			if (h->ops)
+				f(h);
+		}
+	}
+}
+
@@ -0,0 +1,80 @@
+#ifndef EQ_SCOPE_HPP
+#define EQ_SCOPE_HPP
+
+#include "rel.hpp"
+#include "var.hpp"
+
+namespace eq {
+
+/// Temporary relations for what-if queries
+/// Destroying the scope removes its relations and brings back the solution
+/// which was current when the scope was created, without solving.
+/// Scopes can be nested, and are popped in reverse order.
+///
+/// If the domain is changed by other means during the scope, relations
+/// are still removed but the domain is solved again when read.
+/// Other threads must not change the domain during the scope.
+template <typename T>
+class Scope {
+public:
+	using Domain= typename Var<T>::Domain;
+
+	/// @param var Variable of the domain to be changed
+	explicit Scope(Var<T>& var)
+		: domain(staticPtrCast<Domain>(detail::domainOf(var)))
+		, saved(domain->checkpoint())
+		, expected(saved.state)
+	{ }
+
+	~Scope() { pop(); }
+
+	Scope(const Scope&)= delete;
+	Scope& operator=(const Scope&)= delete;
+
+	template <typename E>
+	void rel(E e)
+	{ track(eq::rel(e)); }
+
+	template <typename E>
+	void rel(E e, PriorityVar& priority)
+	{ track(eq::rel(e, priority)); }
+
+	/// Removes relations of the scope. Done also on destruction.
+	void pop()
+	{
+		if (!domain)
+			return;
+
+		bool untouched= valid && domain->getState() == expected;
+		for (auto it= handles.rbegin(); it != handles.rend(); ++it)
+			it->remove();
+		handles.clear();
+
+		if (untouched)
+			domain->restore(std::move(saved));
+		domain.reset();
+	}
+
+private:
+	void track(RelHandle handle)
+	{
+		ensure(domain && "Scope has been popped");
+		// Only changes by the scope itself keep the checkpoint valid
+		if (domain->getState() == expected + 1)
+			++expected;
+		else
+			valid= false;
+		handles.push_back(std::move(handle));
+	}
+
+	RefPtr<Domain> domain;
+	typename Domain::Checkpoint saved;
+	/// State of the domain if it has been changed only by the scope
+	std::size_t expected;
+	bool valid= true;
+	DynArray<RelHandle> handles;
+};
+
+} // eq
+
+#endif // EQ_SCOPE_HPP
@@ -0,0 +1,85 @@
+#include "snapshot.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace eq {
+
+SharedPtr<const Snapshot> Snapshot::open(const std::string& path)
+{
+	int fd= ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		throw std::runtime_error{"Couldn't open snapshot: " + path};
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(detail::FileHeader))) {
+		close(fd);
+		throw std::runtime_error{"Not a model file: " + path};
+	}
+
+	std::size_t size= st.st_size;
+	void* data= mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+		throw std::runtime_error{"Couldn't map snapshot: " + path};
+
+	return SharedPtr<const Snapshot>{new Snapshot{data, size}};
+}
+
+Snapshot::Snapshot(void* data_, std::size_t size_)
+	: data(data_)
+	, size(size_)
+{
+	try {
+		const char* bytes= static_cast<const char*>(data);
+		header= reinterpret_cast<const detail::FileHeader*>(bytes);
+		detail::checkHeader(*header);
+
+		std::size_t var_count= header->varCount;
+		std::size_t offset= sizeof(*header) + sizeof(Model::VarDef)*var_count;
+		rels= reinterpret_cast<const Model::RelDef*>(bytes + offset);
+		offset += sizeof(Model::RelDef)*header->relCount;
+		instrs= reinterpret_cast<const Model::Instr*>(bytes + offset);
+		offset += sizeof(Model::Instr)*header->instrCount;
+
+		if (header->flags & detail::FileHeader::hasSolution) {
+			solution= reinterpret_cast<const Model::Number*>(bytes + offset);
+			offset += sizeof(Model::Number)*var_count;
+		}
+
+		if (offset > size)
+			throw std::runtime_error{"Snapshot is truncated"};
+
+		detail::checkRefs(	header->type,
+							rels, header->relCount,
+							instrs, header->instrCount,
+							var_count);
+	} catch (...) {
+		munmap(data, size);
+		throw;
+	}
+}
+
+Snapshot::~Snapshot()
+{
+	munmap(data, size);
+}
+
+Program Snapshot::program(std::size_t rel) const
+{
+	ensure(rel < relCount());
+	auto&& def= rels[rel];
+	return Program{instrs + def.begin, instrs + def.begin + def.size, def.priority};
+}
+
+void writeSnapshot(	const Model& m,
+					const DynArray<Model::Number>& solution,
+					std::ostream& out)
+{
+	ensure(solution.size() == m.vars.size());
+	detail::writeModelFile(m, solution.data(), out);
+}
+
+} // eq
@@ -0,0 +1,67 @@
+#ifndef EQ_SNAPSHOT_HPP
+#define EQ_SNAPSHOT_HPP
+
+#include "model.hpp"
+#include "rel.hpp"
+#include "var.hpp"
+
+#include <fstream>
+#include <string>
+
+namespace eq {
+
+/// Model file with a solution, mapped read-only to memory
+/// Relations bound from a snapshot point directly to the mapping,
+/// so binding neither builds expressions nor copies instructions
+class Snapshot {
+public:
+	/// Throws if the file can't be mapped or isn't a valid model file
+	static SharedPtr<const Snapshot> open(const std::string& path);
+
+	~Snapshot();
+
+	Snapshot(const Snapshot&)= delete;
+	Snapshot& operator=(const Snapshot&)= delete;
+
+	Model::ValueType getType() const { return header->type; }
+	std::size_t varCount() const { return header->varCount; }
+	std::size_t relCount() const { return header->relCount; }
+
+	Program program(std::size_t rel) const;
+
+	/// @return Values of variables, or null if the file has no solution
+	const Model::Number* getSolution() const { return solution; }
+
+private:
+	Snapshot(void* data, std::size_t size);
+
+	void* data= nullptr;
+	std::size_t size= 0;
+	const detail::FileHeader* header= nullptr;
+	const Model::RelDef* rels= nullptr;
+	const Model::Instr* instrs= nullptr;
+	const Model::Number* solution= nullptr;
+};
+
+/// Writes a model file with a solution
+void writeSnapshot(	const Model& m,
+					const DynArray<Model::Number>& solution,
+					std::ostream& out);
+
+/// Saves relations and current solution of a domain
+/// @param vars All variables of the domain, in the order `bind` will get them
+template <typename T>
+void saveSnapshot(const DynArray<const Var<T>*>& vars, const std::string& path);
+
+/// Binds relations and solution of a snapshot to fresh variables
+/// If `vars` have no other relations, solution of the snapshot becomes
+/// their current value without solving
+/// @param vars Variables in the order they were given to `saveSnapshot`
+template <typename T>
+void bind(SharedPtr<const Snapshot> snapshot, const DynArray<Var<T>*>& vars);
+
+#include "snapshot.tpp"
+
+} // eq
+
+#endif // EQ_SNAPSHOT_HPP
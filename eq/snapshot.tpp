@@ -0,0 +1,52 @@
+template <typename T>
+void saveSnapshot(const DynArray<const Var<T>*>& vars, const std::string& path)
+{
+	ensure(!vars.empty());
+	using Domain= typename Var<T>::Domain;
+	auto lock= detail::lockDomainOf(*vars.front());
+	auto&& domain= static_cast<Domain&>(vars.front()->BaseVar::getDomain());
+	domain.solve();
+
+	DynArray<const BaseVar*> order(vars.begin(), vars.end());
+	Model m= domain.exportModel(order);
+
+	DynArray<Model::Number> solution;
+	for (auto&& v : vars)
+		solution.push_back(toNumber(domain.getValues()[v->getIndex()], m.type));
+
+	std::ofstream file{path, std::ios::binary};
+	writeSnapshot(m, solution, file);
+}
+
+template <typename T>
+void bind(SharedPtr<const Snapshot> snapshot, const DynArray<Var<T>*>& vars)
+{
+	ensure(snapshot->getType() == Model::typeOf<T>() && "Snapshot type mismatch");
+	ensure(snapshot->varCount() == vars.size() && "Var count mismatch");
+	if (vars.empty())
+		return;
+
+	auto handles= std::make_shared<DynArray<VarHandle>>();
+	Set<BaseVar*> var_set;
+	for (auto&& v : vars) {
+		handles->emplace_back(*v);
+		var_set.insert(v);
+	}
+	ensure(var_set.size() == vars.size() && "Same var given twice");
+
+	using Domain= typename Var<T>::Domain;
+	detail::DomainsLock lock{var_set};
+	auto&& domain= detail::mergeDomainsOf<Domain>(var_set);
+	bool fresh= domain.relCount() == 0 && domain.varCount() == vars.size();
+
+	for (std::size_t i= 0; i < snapshot->relCount(); ++i)
+		domain.template addProgram<Var<T>>(snapshot->program(i), snapshot, handles);
+
+	if (auto solution= snapshot->getSolution()) {
+		DynArray<T> values;
+		for (std::size_t i= 0; i < vars.size(); ++i)
+			values.push_back(numberAs<T>(solution[i], snapshot->getType()));
+		domain.seed(*handles, values.data(), fresh);
+	}
+}
+
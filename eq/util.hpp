@@ -2,11 +2,15 @@
 #define EQ_UTIL_HPP
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <functional>
 #include <list>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <set>
+#include <stdexcept>
 #include <vector>
 
 namespace eq {
@@ -39,6 +43,16 @@ template <typename T1, typename T2>
 constexpr bool isSame() { return std::is_same<T1, T2>::value; }
 #define ensure assert
 
+/// Lock for tiny critical sections, usable with std::lock_guard
+class SpinLock {
+public:
+	void lock() { while (locked.exchange(true, std::memory_order_acquire)); }
+	void unlock() { locked.store(false, std::memory_order_release); }
+
+private:
+	std::atomic<bool> locked{false};
+};
+
 template <typename T>
 struct FuncPtr;
 
@@ -12,6 +12,8 @@ struct ChooseSolver { static_assert(!sizeof(T), "Type not supported"); };
 template <>
 struct ChooseSolver<int> { using Type= ConstraintSolver; };
 template <>
+struct ChooseSolver<std::int64_t> { using Type= ConstraintSolver64; };
+template <>
 struct ChooseSolver<double> { using Type= LinearSolver; };
 
 } // detail
@@ -20,8 +22,9 @@ template <typename T>
 using ChooseSolver= typename detail::ChooseSolver<T>::Type;
 
 /// Variable that has value determined by constraints
-/// Currently supported types are int and double
-/// Var<int> uses ConstraintSolver and Var<double> uses LinearSolver
+/// Currently supported types are int, std::int64_t and double
+/// Var<int> uses ConstraintSolver, Var<std::int64_t> ConstraintSolver64
+/// and Var<double> uses LinearSolver
 template <typename T, VarType type= VarType::normal>
 class Var : public BaseVar {
 
@@ -29,17 +32,16 @@ public:
 	/// @todo Maybe solver shouldn't be chosen implicitly
 	using Domain= eq::Domain<ChooseSolver<T>>;
 
+	/// Doesn't allocate; domain is created when first related or read
 	Var()
-	{
-		/// @todo Create domain as late as possible
-		setDomainPtr(std::make_shared<Domain>());
-		getDomain().addVar(*this);
-	}
+		: BaseVar(ops) { }
 
 	~Var()
 	{
-		if (getDomainPtr())
+		if (getDomainPtr()) {
+			auto lock= detail::lockDomainOf(*this);
 			getDomain().removeVar(*this);
+		}
 	}
 
 	Var(const Var&)= default;
@@ -47,26 +49,64 @@ public:
 	Var& operator=(const Var&)= default;
 	Var& operator=(Var&&)= default;
 
-	operator const T&() const
+	/// Blocks until solved
+	/// Returned by value, as values move when the domain changes
+	operator T() const
 	{
+		auto lock= detail::lockDomainOf(*this);
 		getDomain().solve();
-		return value;
+		return get();
+	}
+
+	/// Last committed solution. Never blocks, but starts solving
+	/// in a background thread if relations have changed.
+	T lastValue() const
+	{
+		auto lock= detail::lockDomainOf(*this);
+		getDomain().poll();
+		return get();
+	}
+
+	/// Solution of relations present at the time of the call
+	/// Solving is done in a background thread, see `Executor::global()`
+	std::future<T> valueAsync() const
+	{
+		auto lock= detail::lockDomainOf(*this);
+		return getDomain().valueAsync(*this);
 	}
 
 	void clear()
 	{
+		if (!getDomainPtr())
+			return;
+		auto lock= detail::lockDomainOf(*this);
 		getDomain().removeVar(*this);
 		getDomain().addVar(*this);
 	}
 
-	/// @todo Could be private
-	T& get() { return value; }
-
 private:
+	/// Value is stored in the domain, so the reference is invalidated
+	/// by adding or removing variables of the domain
+	/// Variable must have a domain, i.e. it has been related or read
+	T& get() { return getDomain().getValue(getIndex()); }
+	const T& get() const { return getDomain().getValue(getIndex()); }
+
 	Domain& getDomain() const
 	{ return static_cast<Domain&>(BaseVar::getDomain()); }
 
-	T value= 0;
+	static BaseDomainPtr makeDomain()
+	{ return BaseDomainPtr{new Domain}; }
+
+	static void addToDomain(BaseDomain& d, BaseVar& var)
+	{ static_cast<Domain&>(d).addVar(static_cast<Var&>(var)); }
+
+	static const detail::DomainOps ops;
+};
+
+template <typename T, VarType type>
+const detail::DomainOps Var<T, type>::ops= {
+	&Var<T, type>::makeDomain,
+	&Var<T, type>::addToDomain
 };
 
 } // eq
@@ -1,6 +1,8 @@
 #ifndef EQ_VARHANDLE_HPP
 #define EQ_VARHANDLE_HPP
 
+#include "util.hpp"
+
 namespace eq {
 
 class BaseVar;
@@ -70,14 +72,17 @@ public:
 	{
 		clear();
 
+		std::lock_guard<SpinLock> lock(v.handlesLock);
 		var= &v;
 		var->handles.push_back(this);
 	}
 
 	void clear()
 	{
-		if (var)
+		if (var) {
+			std::lock_guard<SpinLock> lock(var->handlesLock);
 			eraseFrom(var->handles, this);
+		}
 		var= nullptr;
 	}
 
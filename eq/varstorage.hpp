@@ -5,47 +5,33 @@
 
 namespace eq {
 
-template <typename T, typename M>
+/// Solver-side models of variables
+/// Indexed like the values of the domain, see `BaseVar::getIndex`
+template <typename M>
 class VarStorage {
 public:
-	struct VarInfo {
-		VarInfo()= default;
-		VarInfo(T* actual, M* model)
-			: actual(actual)
-			, model(model)
-		{ }
-		VarInfo(const VarInfo&)= default;
-		VarInfo(VarInfo&& other) : VarInfo(other) {}
-
-		VarInfo& operator=(const VarInfo&)= default;
-		VarInfo& operator=(VarInfo&& other){
-			// std::vector insists using move assign even when its deleted... (gcc 4.8.1)
-			return operator=(other); 
-		}
-
-		T* actual= nullptr;
-		M* model= nullptr;
-	};
-	
-	using Iter= typename DynArray<VarInfo>::iterator;
-	using CIter= typename DynArray<VarInfo>::const_iterator;
-
-	void add(T& ref, M& model);
-	VarInfo& getInfo(const T& ref);
-	void tryEraseInfo(const T& ref);
-
-	Iter begin() { return vars.begin(); }
-	Iter end() { return vars.end(); }
-
-	CIter begin() const { return vars.begin(); }
-	CIter end() const { return vars.end(); }
+	using CIter= typename DynArray<M*>::const_iterator;
 
-private:
-	DynArray<VarInfo> vars;
+	void add(std::size_t index, M& model)
+	{
+		ensure(index == models.size() && "Vars must be added in index order");
+		models.push_back(&model);
+	}
 
-};
+	M& get(std::size_t index) const
+	{
+		ensure(index < models.size());
+		return *models[index];
+	}
+
+	std::size_t size() const { return models.size(); }
 
-#include "varstorage.tpp"
+	CIter begin() const { return models.begin(); }
+	CIter end() const { return models.end(); }
+
+private:
+	DynArray<M*> models;
+};
 
 } // eq
 
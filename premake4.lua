@@ -22,6 +22,7 @@ solution "gecode_test"
     vpaths { ["*"] = "./eq/**" }
 
     links { "ortools",
+			"pthread",
 			"stdc++" }
 	buildoptions { "-std=c++11" }
 